@@ -0,0 +1,526 @@
+#include "stdafx.h"
+#include "resolve_path.h"
+#include "resolve_path_reference.h"
+
+#include <benchmark/benchmark.h>
+
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+// Every allocation in the process goes through here, so the benchmarks can report
+// how many allocations a call makes on top of its time. Counted per thread, so that
+// benchmarks run on several threads only see their own allocations. Every form of new
+// forwards to the plain or the aligned one, and every delete to release.
+static thread_local std::size_t allocation_count = 0;
+
+// Not inlined, because GCC takes free on a pointer from operator new for a mismatch
+// once it sees both at a call site (-Wmismatched-new-delete).
+NOINLINE void release(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+#ifdef __cpp_aligned_new
+NOINLINE void release_aligned(void *ptr) noexcept {
+#if defined(_MSC_VER)
+	_aligned_free(ptr);
+#else
+	std::free(ptr);
+#endif
+}
+#endif
+
+void *operator new(std::size_t size) {
+	++allocation_count;
+	if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+	throw std::bad_alloc{};
+}
+
+void *operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void *ptr) noexcept { release(ptr); }
+void operator delete[](void *ptr) noexcept { release(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { release(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { release(ptr); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+	try {
+		return ::operator new(size);
+	}
+	catch (const std::bad_alloc &) {
+		return nullptr;
+	}
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept { return ::operator new(size, tag); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { release(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { release(ptr); }
+
+#ifdef __cpp_aligned_new
+void *operator new(std::size_t size, std::align_val_t alignment) {
+	++allocation_count;
+	const std::size_t align = std::max(sizeof(void *), static_cast<std::size_t>(alignment));
+#if defined(_MSC_VER)
+	if (void *ptr = _aligned_malloc(size == 0 ? 1 : size, align)) return ptr;
+#else
+	void *ptr;
+	if (posix_memalign(&ptr, align, size == 0 ? 1 : size) == 0) return ptr;
+#endif
+	throw std::bad_alloc{};
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) { return ::operator new(size, alignment); }
+void operator delete(void *ptr, std::align_val_t) noexcept { release_aligned(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { release_aligned(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { release_aligned(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { release_aligned(ptr); }
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	try {
+		return ::operator new(size, alignment);
+	}
+	catch (const std::bad_alloc &) {
+		return nullptr;
+	}
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &tag) noexcept { return ::operator new(size, alignment, tag); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { release_aligned(ptr); }
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { release_aligned(ptr); }
+#endif
+
+// Runs func once per iteration and reports bytes/sec over bytes_per_op and the
+// average number of allocations per call.
+template <typename Func>
+void run_benchmark(benchmark::State &state, std::size_t bytes_per_op, Func func) {
+	const std::size_t allocations = allocation_count;
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(func());
+	}
+
+	state.SetBytesProcessed(state.iterations() * bytes_per_op);
+	state.counters["allocs/op"] = benchmark::Counter(
+		static_cast<double>(allocation_count - allocations), benchmark::Counter::kAvgIterations);
+}
+
+std::string deep_path(const char *root, std::size_t depth) {
+	std::string path{ root };
+	for (std::size_t i = 0; i < depth; ++i) {
+		path.append("generated_" + std::to_string(i) + "/");
+	}
+	return path + "file.h";
+}
+
+std::string parent_heavy_path(std::size_t depth) {
+	std::string path;
+	for (std::size_t i = 0; i < depth; ++i) {
+		path.append("dir_" + std::to_string(i) + "/../");
+	}
+	return path + "../../include/./file.h";
+}
+
+// An input path and the project directory it is resolved against.
+struct PathCase {
+	std::string path;
+	std::string src_prj_path;
+	bool is_windows;
+
+	std::vector<std::string> src_prj_dir() const {
+		std::string normalized_path{ src_prj_path };
+		return convert_to_internal_path(normalized_path, is_windows);
+	}
+};
+
+const PathCase posix_short{ "a/b/c", "/data/src/project", false };
+const PathCase posix_deep{ deep_path("", 30), "/data/src/project", false };
+const PathCase windows_short{ "src\\include\\foo.h", "Z:\\data\\src\\project", true };
+const PathCase windows_deep{ deep_path("C:\\", 30), "Z:\\data\\src\\project", true };
+const PathCase parent_heavy{ parent_heavy_path(20), "/data/src/project", false };
+const PathCase repeated_separators{ "a////b\\\\\\\\c//d////e\\\\\\\\f", "Z:\\data\\src\\project", true };
+// Subpaths long enough for the SIMD kernels of the validating tokenizer.
+const PathCase posix_long_names{ "third_party/generated_protocol_buffers/include/network_message_definitions.pb.h", "/data/src/project", false };
+const PathCase windows_long_names{ "third_party\\generated_protocol_buffers\\include\\network_message_definitions.pb.h", "Z:\\data\\src\\project", true };
+
+#define PATH_CASES(func) \
+	BENCHMARK_CAPTURE(func, posix_short, posix_short); \
+	BENCHMARK_CAPTURE(func, posix_deep, posix_deep); \
+	BENCHMARK_CAPTURE(func, windows_short, windows_short); \
+	BENCHMARK_CAPTURE(func, windows_deep, windows_deep); \
+	BENCHMARK_CAPTURE(func, parent_heavy, parent_heavy); \
+	BENCHMARK_CAPTURE(func, repeated_separators, repeated_separators)
+
+// The Windows roots other than an uppercase drive, against a project directory on Z:.
+const PathCase unc{ "\\\\server\\share\\src\\include\\foo.h", "Z:\\data\\src\\project", true };
+const PathCase long_path{ "\\\\?\\UNC\\server\\share\\src\\include\\foo.h", "Z:\\data\\src\\project", true };
+const PathCase lowercase_drive{ "c:\\src\\include\\foo.h", "Z:\\data\\src\\project", true };
+const PathCase drive_relative{ "z:src\\include\\foo.h", "Z:\\data\\src\\project", true };
+
+#define WINDOWS_ROOT_CASES(func) \
+	BENCHMARK_CAPTURE(func, unc, unc); \
+	BENCHMARK_CAPTURE(func, long_path, long_path); \
+	BENCHMARK_CAPTURE(func, lowercase_drive, lowercase_drive); \
+	BENCHMARK_CAPTURE(func, drive_relative, drive_relative)
+
+void BM_split_path(benchmark::State &state, const PathCase &path_case) {
+	const std::string &path = path_case.path;
+	run_benchmark(state, path.size(), [&path]() { return split_path(path); });
+}
+PATH_CASES(BM_split_path);
+
+void BM_split_path_regex(benchmark::State &state, const PathCase &path_case) {
+	const std::string &path = path_case.path;
+	run_benchmark(state, path.size(), [&path]() { return split_path_regex(path); });
+}
+PATH_CASES(BM_split_path_regex);
+
+void BM_split_path_view(benchmark::State &state, const PathCase &path_case) {
+	const std::string &path = path_case.path;
+	std::vector<boost::string_view> subpaths;
+	run_benchmark(state, path.size(), [&]() { split_path(path, subpaths); return subpaths.size(); });
+}
+PATH_CASES(BM_split_path_view);
+
+void BM_is_valid_path(benchmark::State &state, const PathCase &path_case) {
+	run_benchmark(state, path_case.path.size(), [&path_case]() { return is_valid_path(path_case.path, path_case.is_windows); });
+}
+PATH_CASES(BM_is_valid_path);
+WINDOWS_ROOT_CASES(BM_is_valid_path);
+
+void BM_is_normalized_path(benchmark::State &state, const PathCase &path_case) {
+	const std::string normalized_path = *normalize_path(path_case.path, path_case.src_prj_dir());
+	run_benchmark(state, normalized_path.size(), [&]() { return is_normalized_path(normalized_path, path_case.is_windows); });
+}
+PATH_CASES(BM_is_normalized_path);
+
+void BM_is_canonical_path(benchmark::State &state, const PathCase &path_case) {
+	const std::string normalized_path = *normalize_path(path_case.path, path_case.src_prj_dir());
+	run_benchmark(state, normalized_path.size(), [&]() { return is_canonical_path(normalized_path, path_case.is_windows); });
+}
+PATH_CASES(BM_is_canonical_path);
+WINDOWS_ROOT_CASES(BM_is_canonical_path);
+
+void BM_normalize(benchmark::State &state, const PathCase &path_case) {
+	const std::vector<std::string> src_prj_dir = path_case.src_prj_dir();
+	std::vector<std::string> subpaths = split_path(path_case.path);
+	if (!is_root(subpaths[0], path_case.is_windows, true)) {
+		subpaths.insert(subpaths.begin(), src_prj_dir.begin(), src_prj_dir.end());
+	}
+	run_benchmark(state, path_case.path.size(), [&]() { return normalize(subpaths, path_case.is_windows); });
+}
+PATH_CASES(BM_normalize);
+
+void BM_normalize_path(benchmark::State &state, const PathCase &path_case) {
+	const std::vector<std::string> src_prj_dir = path_case.src_prj_dir();
+	run_benchmark(state, path_case.path.size(), [&]() { return normalize_path(path_case.path, src_prj_dir); });
+}
+PATH_CASES(BM_normalize_path);
+
+void BM_normalize_path_reference(benchmark::State &state, const PathCase &path_case) {
+	const std::vector<std::string> src_prj_dir = path_case.src_prj_dir();
+	run_benchmark(state, path_case.path.size(), [&]() { return normalize_path_reference(path_case.path, src_prj_dir); });
+}
+PATH_CASES(BM_normalize_path_reference);
+WINDOWS_ROOT_CASES(BM_normalize_path_reference);
+
+void BM_normalize_path_project_root(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	std::string normalized_path;
+	run_benchmark(state, path_case.path.size(), [&]() { return normalize_path(path_case.path, root, normalized_path); });
+}
+PATH_CASES(BM_normalize_path_project_root);
+WINDOWS_ROOT_CASES(BM_normalize_path_project_root);
+
+// Copying the input into the reused buffer is part of every iteration, as it would be
+// for a caller normalizing paths it reads into one buffer.
+void BM_normalize_path_in_place(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	std::string buffer;
+	run_benchmark(state, path_case.path.size(), [&]() {
+		buffer.assign(path_case.path);
+		return normalize_path_in_place(buffer, root);
+	});
+}
+PATH_CASES(BM_normalize_path_in_place);
+WINDOWS_ROOT_CASES(BM_normalize_path_in_place);
+
+// Hashing the normalized path, against normalizing it and hashing the result.
+void BM_normalized_hash(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	run_benchmark(state, path_case.path.size(), [&]() { return normalized_hash(path_case.path, root); });
+}
+PATH_CASES(BM_normalized_hash);
+WINDOWS_ROOT_CASES(BM_normalized_hash);
+
+void BM_normalize_path_then_hash(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	run_benchmark(state, path_case.path.size(), [&]() { return normalized_path_hash(*normalize_path(path_case.path, root)); });
+}
+PATH_CASES(BM_normalize_path_then_hash);
+
+// Moving a recorded path to another project directory, against normalizing it again
+// in BM_normalize_path_project_root.
+void BM_rebase_path(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	RebasablePath rebasable_path;
+	normalize_path(path_case.path, root, rebasable_path);
+
+	std::string moved_path = path_case.is_windows ? "Y:\\mnt\\ws\\data\\src\\project" : "/mnt/ws/data/src/project";
+	const ProjectRoot moved_root{ convert_to_internal_path(moved_path, path_case.is_windows) };
+	std::string normalized_path;
+	run_benchmark(state, path_case.path.size(), [&]() { return rebase_path(rebasable_path, moved_root, normalized_path); });
+}
+PATH_CASES(BM_rebase_path);
+
+// Normalizing a path that already is normalized, which returns it unchanged.
+void BM_normalize_path_canonical(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	const std::string canonical_path = *normalize_path(path_case.path, root);
+	std::string normalized_path;
+	run_benchmark(state, canonical_path.size(), [&]() { return normalize_path(canonical_path, root, normalized_path); });
+}
+PATH_CASES(BM_normalize_path_canonical);
+
+void BM_normalize_path_view_canonical(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	const std::string canonical_path = *normalize_path(path_case.path, root);
+	std::string buffer;
+	run_benchmark(state, canonical_path.size(), [&]() { return normalize_path_view(canonical_path, root, buffer); });
+}
+PATH_CASES(BM_normalize_path_view_canonical);
+
+// The flavor instantiations called directly, without the dispatch on
+// ProjectRoot::is_windows, to compare against BM_normalize_path_project_root.
+template <typename Flavor>
+void run_normalize_path_flavor(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	std::string normalized_path;
+	run_benchmark(state, path_case.path.size(), [&]() { return normalize_path<Flavor>(path_case.path, root, normalized_path); });
+}
+
+void BM_normalize_path_posix_flavor(benchmark::State &state, const PathCase &path_case) {
+	run_normalize_path_flavor<PosixFlavor>(state, path_case);
+}
+BENCHMARK_CAPTURE(BM_normalize_path_posix_flavor, posix_short, posix_short);
+BENCHMARK_CAPTURE(BM_normalize_path_posix_flavor, posix_deep, posix_deep);
+BENCHMARK_CAPTURE(BM_normalize_path_posix_flavor, parent_heavy, parent_heavy);
+BENCHMARK_CAPTURE(BM_normalize_path_posix_flavor, long_names, posix_long_names);
+
+void BM_normalize_path_windows_flavor(benchmark::State &state, const PathCase &path_case) {
+	run_normalize_path_flavor<WindowsFlavor>(state, path_case);
+}
+BENCHMARK_CAPTURE(BM_normalize_path_windows_flavor, windows_short, windows_short);
+BENCHMARK_CAPTURE(BM_normalize_path_windows_flavor, windows_deep, windows_deep);
+BENCHMARK_CAPTURE(BM_normalize_path_windows_flavor, repeated_separators, repeated_separators);
+BENCHMARK_CAPTURE(BM_normalize_path_windows_flavor, long_names, windows_long_names);
+
+void BM_normalize_path_compact(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	SubpathInterner interner;
+	CompactPath compact_path;
+	run_benchmark(state, path_case.path.size(), [&]() { return normalize_path(path_case.path, root, interner, compact_path); });
+}
+PATH_CASES(BM_normalize_path_compact);
+
+void BM_normalized_path_cache_hit(benchmark::State &state, const PathCase &path_case) {
+	const ProjectRoot root{ path_case.src_prj_dir() };
+	NormalizedPathCache cache{ 1024 };
+	std::string normalized_path;
+	cache.normalize_path(path_case.path, root, normalized_path);
+	run_benchmark(state, path_case.path.size(), [&]() { return cache.normalize_path(path_case.path, root, normalized_path); });
+}
+PATH_CASES(BM_normalized_path_cache_hit);
+
+void BM_find_separator(benchmark::State &state, const char *(*kernel)(const char *, const char *)) {
+	const std::string path = deep_path("/", 30);
+	const char *last = path.data() + path.size();
+
+	run_benchmark(state, path.size(), [&]() {
+		std::size_t count = 0;
+		for (const char *iter = path.data(); (iter = kernel(iter, last)) != last; ++iter) ++count;
+		return count;
+	});
+}
+BENCHMARK_CAPTURE(BM_find_separator, scalar, find_separator_scalar);
+BENCHMARK_CAPTURE(BM_find_separator, dispatch, find_separator);
+#if SIMD_ON == 1
+BENCHMARK_CAPTURE(BM_find_separator, sse2, find_separator_sse2);
+BENCHMARK_CAPTURE(BM_find_separator, avx2, find_separator_avx2);
+#endif
+
+// A million generated includes, built once and shared by the batch and allocator benchmarks.
+const std::vector<std::string> &generated_paths() {
+	static const std::vector<std::string> paths = []() {
+		std::vector<std::string> paths;
+		for (std::size_t i = 0; i < 1000000; ++i) {
+			paths.push_back("../include/gen_" + std::to_string(i % 997) + "/./module/../foo_" + std::to_string(i) + ".h");
+		}
+		return paths;
+	}();
+	return paths;
+}
+
+void BM_normalize_paths(benchmark::State &state) {
+	const ProjectRoot root{ posix_short.src_prj_dir() };
+	const std::vector<boost::string_view> paths(generated_paths().begin(), generated_paths().end());
+	NormalizedPaths normalized_paths;
+
+	for (auto _ : state) {
+		normalize_paths(paths, root, normalized_paths, static_cast<std::size_t>(state.range(0)));
+	}
+
+	state.SetItemsProcessed(state.iterations() * paths.size());
+}
+BENCHMARK(BM_normalize_paths)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Normalizes batches of generated paths and keeps each batch alive until it is
+// complete, as a caller collecting results would, on 1 to 16 threads at once.
+const std::size_t allocator_batch_size = 1024;
+
+template <typename Func>
+void run_allocator_benchmark(benchmark::State &state, Func normalize_batch) {
+	const ProjectRoot root{ posix_short.src_prj_dir() };
+	const std::vector<std::string> &paths = generated_paths();
+	std::size_t offset = static_cast<std::size_t>(state.thread_index()) * allocator_batch_size;
+	std::size_t batch_bytes = 0;
+	for (std::size_t i = 0; i < allocator_batch_size; ++i) batch_bytes += paths[i].size();
+
+	run_benchmark(state, batch_bytes, [&]() {
+		offset = (offset + allocator_batch_size) % (paths.size() - allocator_batch_size);
+		return normalize_batch(&paths[offset], root);
+	});
+	state.SetItemsProcessed(state.iterations() * allocator_batch_size);
+}
+
+// Every result is its own std::string from the global heap.
+void BM_allocator_malloc(benchmark::State &state) {
+	std::vector<boost::optional<std::string>> results;
+	results.reserve(allocator_batch_size);
+
+	run_allocator_benchmark(state, [&results](const std::string *paths, const ProjectRoot &root) {
+		results.clear();
+		for (std::size_t i = 0; i < allocator_batch_size; ++i) {
+			results.push_back(normalize_path(paths[i], root));
+		}
+		return results.size();
+	});
+}
+BENCHMARK(BM_allocator_malloc)->ThreadRange(1, 16)->UseRealTime();
+
+// A per-thread pool of size classes, the way jemalloc and tcmalloc serve small
+// strings from thread caches instead of a shared heap.
+void BM_allocator_pool(benchmark::State &state) {
+	boost::container::pmr::unsynchronized_pool_resource pool;
+	boost::container::pmr::vector<boost::container::pmr::string> results{ &pool };
+	results.reserve(allocator_batch_size);
+
+	run_allocator_benchmark(state, [&](const std::string *paths, const ProjectRoot &root) {
+		results.clear();
+		for (std::size_t i = 0; i < allocator_batch_size; ++i) {
+			results.emplace_back();
+			if (!normalize_path(paths[i], root, results.back())) results.back().clear();
+		}
+		return results.size();
+	});
+}
+BENCHMARK(BM_allocator_pool)->ThreadRange(1, 16)->UseRealTime();
+
+// A per-thread monotonic arena over a buffer that fits a whole batch. Results are
+// never freed one by one, the whole batch goes with one release().
+void BM_allocator_arena(benchmark::State &state) {
+	std::vector<char> buffer(256 << 10);
+	boost::container::pmr::monotonic_buffer_resource arena{ buffer.data(), buffer.size() };
+	std::vector<boost::optional<boost::string_view>> results;
+	results.reserve(allocator_batch_size);
+
+	run_allocator_benchmark(state, [&](const std::string *paths, const ProjectRoot &root) {
+		results.clear();
+		arena.release();
+		for (std::size_t i = 0; i < allocator_batch_size; ++i) {
+			results.push_back(normalize_path(paths[i], root, arena));
+		}
+		return results.size();
+	});
+}
+BENCHMARK(BM_allocator_arena)->ThreadRange(1, 16)->UseRealTime();
+
+// A trie over count generated includes of the same shape as generated_paths(), made
+// one at a time so that tries of tens of millions of paths need not keep the strings.
+// Only the last one is kept, since every size is benchmarked for both queries in turn.
+struct TrieFixture {
+	std::size_t count;
+	SubpathInterner interner;
+	std::vector<CompactPath> compact_paths;
+	PathTrie trie;
+	double build_seconds;
+};
+
+const TrieFixture &trie_fixture(std::size_t count) {
+	static std::unique_ptr<TrieFixture> fixture;
+	if (fixture && fixture->count == count) return *fixture;
+
+	fixture.reset();
+	fixture.reset(new TrieFixture{});
+	fixture->count = count;
+	fixture->compact_paths.resize(count);
+
+	const ProjectRoot root{ posix_short.src_prj_dir() };
+	for (std::size_t i = 0; i < count; ++i) {
+		const std::string path = "../include/gen_" + std::to_string(i % 997) + "/./module/../foo_" + std::to_string(i) + ".h";
+		normalize_path(path, root, fixture->interner, fixture->compact_paths[i]);
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	fixture->trie.insert(fixture->compact_paths);
+	fixture->build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return *fixture;
+}
+
+void BM_path_trie(benchmark::State &state) {
+	const TrieFixture &fixture = trie_fixture(static_cast<std::size_t>(state.range(0)));
+
+	std::size_t index = 0;
+	for (auto _ : state) {
+		const CompactPath &compact_path = fixture.compact_paths[(index += 7919) % fixture.compact_paths.size()];
+		benchmark::DoNotOptimize(state.range(1) == 0 ? fixture.trie.contains(compact_path) : !!fixture.trie.longest_prefix(compact_path));
+	}
+
+	state.counters["build_s"] = fixture.build_seconds;
+}
+BENCHMARK(BM_path_trie)->ArgNames({ "entries", "longest_prefix" })
+	->Args({ 1000000, 0 })->Args({ 1000000, 1 })->Args({ 10000000, 0 })->Args({ 10000000, 1 });
+
+#ifndef _WIN32
+// Resolves a path through a symlink into a real directory tree 8 deep, with a warm
+// PhysicalPathResolver or with boost::filesystem::canonical, which lstats every
+// prefix again on every call as realpath does.
+void BM_resolve_path_physical(benchmark::State &state, bool is_cached) {
+	namespace fs = boost::filesystem;
+
+	const fs::path dir = fs::canonical(fs::temp_directory_path()) / fs::unique_path("bench_resolve_path_%%%%%%%%");
+	const std::string tree_path = deep_path("", 8);
+	fs::create_directories(dir / tree_path);
+	fs::create_symlink("generated_0", dir / "link");
+	const std::string path = "link" + tree_path.substr(tree_path.find('/'));
+
+	std::string src_prj_path = dir.string();
+	const ProjectRoot root{ convert_to_internal_path(src_prj_path, false) };
+	PhysicalPathResolver resolver{ std::chrono::steady_clock::duration::max() };
+	std::string resolved_path;
+
+	if (is_cached) {
+		run_benchmark(state, path.size(), [&]() { return resolver.resolve_path(path, root, resolved_path); });
+	}
+	else {
+		const fs::path fs_path = dir / path;
+		run_benchmark(state, path.size(), [&]() { return fs::canonical(fs_path).native().size(); });
+	}
+
+	fs::remove_all(dir);
+}
+BENCHMARK_CAPTURE(BM_resolve_path_physical, cached, true);
+BENCHMARK_CAPTURE(BM_resolve_path_physical, canonical, false);
+#endif
+
+BENCHMARK_MAIN();
@@ -0,0 +1,9 @@
+#include "stdafx.h"
+
+#include <filesystem>
+
+// Kept apart from fuzz_resolve_path.cpp because std::filesystem needs C++17, while
+// the library is built as C++14.
+std::string lexically_normal(const std::string &path) {
+	return std::filesystem::path{ path }.lexically_normal().generic_string();
+}
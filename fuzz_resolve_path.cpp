@@ -0,0 +1,243 @@
+#include "stdafx.h"
+#include "resolve_path.h"
+#include "resolve_path_reference.h"
+
+#include <fstream>
+#include <iterator>
+#include <random>
+
+// Checks inputs against the reference pipeline, and normalize_path also against
+// std::filesystem, under a POSIX, a Windows drive and a Windows share project
+// directory. Built as libFuzzer targets with RESOLVE_PATH_LIBFUZZER, one per
+// RESOLVE_PATH_FUZZ_* entry point and one for everything, otherwise as a driver that
+// replays inputs or generates random ones.
+
+#ifdef RESOLVE_PATH_LEXICALLY_NORMAL
+// Defined in fuzz_lexically_normal.cpp, which is compiled as C++17.
+std::string lexically_normal(const std::string &path);
+
+// std::filesystem only knows the separators and roots of the platform it runs on, so
+// the path is resolved into a generic POSIX path first, with the Windows root as the
+// first directory, "/Z:" or "/||server|share". Only called for paths normalize_path
+// accepts.
+std::string to_generic_path(const std::string &path, const ProjectRoot &root) {
+	const std::string root_path = root.path().to_string();
+	if (!root.is_windows()) return path[0] == '/' ? path : root_path + "/" + path;
+
+	const auto generic_root = [](std::string windows_root) {
+		std::replace(windows_root.begin(), windows_root.end(), '/', '|');
+		return "/" + windows_root;
+	};
+	const WindowsPathReference split = *split_windows_path_reference(path);
+
+	std::string generic_path;
+	if (split.root.empty() || split.is_drive_relative) {
+		generic_path = generic_root(root.drive().to_string()) + root_path.substr(root.drive().size());
+	}
+	else {
+		generic_path = generic_root(split.root == "/" ? root.drive().to_string() : split.root);
+	}
+
+	for (const std::string &subpath : split.subpaths) {
+		if (generic_path.back() != '/') generic_path.push_back('/');
+		generic_path.append(subpath);
+	}
+	return generic_path;
+}
+
+std::string without_trailing_separator(std::string path) {
+	if (path.size() > 1 && path.back() == '/') path.pop_back();
+	return path;
+}
+#endif
+
+void check_split_path(const std::string &path) {
+	const std::vector<std::string> expected = split_path_regex(path);
+	assert(split_path(path) == expected);
+
+	std::vector<boost::string_view> subpaths;
+	split_path(path, subpaths);
+	assert(std::equal(subpaths.begin(), subpaths.end(), expected.begin(), expected.end()));
+}
+
+void check_is_valid_path(const std::string &path) {
+	for (const bool is_windows : { false, true }) {
+		assert(is_valid_path(path, is_windows) == is_valid_path_reference(path, is_windows));
+		assert(is_normalized_path(path, is_windows) == is_normalized_path_reference(path, is_windows));
+	}
+}
+
+// moved_dir is where the project directory is rebased to.
+void check_path(const std::string &path, const std::vector<std::string> &src_prj_dir, const std::vector<std::string> &moved_dir) {
+	static SubpathInterner interner;
+	const ProjectRoot root{ src_prj_dir };
+
+	const boost::optional<std::string> expected = normalize_path_reference(path, src_prj_dir);
+	assert(normalize_path(path, src_prj_dir) == expected);
+	assert(normalize_path(path, root) == expected);
+
+	assert(is_canonical_path(path, root.is_windows()) == (expected != boost::none && *expected == path));
+	std::string buffer;
+	const boost::optional<boost::string_view> normalized_view = normalize_path_view(path, root, buffer);
+	assert(expected == boost::none ? normalized_view == boost::none : normalized_view && *normalized_view == *expected);
+
+	const boost::optional<std::uint64_t> hash = normalized_hash(path, root);
+	assert(expected == boost::none ? hash == boost::none : hash && *hash == normalized_path_hash(*expected));
+	assert(same_normalized(path, path, root) == (expected != boost::none));
+	assert(expected == boost::none || same_normalized(path, *expected, root));
+
+	std::string in_place_path{ path };
+	assert(normalize_path_in_place(in_place_path, root) == (expected != boost::none));
+	assert(expected == boost::none || in_place_path == *expected);
+
+	RebasablePath rebasable_path;
+	std::string rebased_path;
+	assert(normalize_path(path, root, rebasable_path) == (expected != boost::none));
+	assert(expected == boost::none || (rebase_path(rebasable_path, root, rebased_path) && rebased_path == *expected));
+	if (expected) {
+		const boost::optional<std::string> moved_expected = normalize_path_reference(path, moved_dir);
+		assert(rebase_path(rebasable_path, ProjectRoot{ moved_dir }, rebased_path) == (moved_expected != boost::none));
+		assert(moved_expected == boost::none || rebased_path == *moved_expected);
+	}
+
+	CompactPath compact_path;
+	assert(normalize_path(path, root, interner, compact_path) == (expected != boost::none));
+	assert(expected == boost::none || expand_path(compact_path, interner) == *expected);
+
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+	FixedPath<1024> fixed_path;
+	if (path.size() < 512) {
+		const boost::string_view root_path = root.path();
+		const bool is_valid = root.is_windows() ?
+			normalize_path_constexpr<WindowsFlavor>(path, root_path, fixed_path) :
+			normalize_path_constexpr<PosixFlavor>(path, root_path, fixed_path);
+		assert(is_valid == (expected != boost::none));
+		assert(expected == boost::none || fixed_path.view() == *expected);
+	}
+#endif
+
+	if (expected) {
+		assert(is_normalized_path(*expected, root.is_windows()));
+		assert(is_canonical_path(*expected, root.is_windows()));
+		assert(normalize_path(*expected, root) == expected);
+
+#ifdef RESOLVE_PATH_LEXICALLY_NORMAL
+		const std::string generic_expected = to_generic_path(*expected, root);
+		assert(without_trailing_separator(lexically_normal(to_generic_path(path, root))) == without_trailing_separator(generic_expected));
+#endif
+	}
+}
+
+void check_normalize_path(const std::string &path) {
+	static const std::vector<std::string> posix_dir = []() {
+		std::string src_prj_path{ "/data/sub" };
+		return convert_to_internal_path(src_prj_path, false);
+	}();
+	static const std::vector<std::string> windows_dir = []() {
+		std::string src_prj_path{ "Z:\\data\\sub" };
+		return convert_to_internal_path(src_prj_path, true);
+	}();
+	static const std::vector<std::string> share_dir = []() {
+		std::string src_prj_path{ "//server/share/data" };
+		return convert_to_internal_path(src_prj_path, true);
+	}();
+
+	static const std::vector<std::string> moved_posix_dir = []() {
+		std::string src_prj_path{ "/mnt/ws" };
+		return convert_to_internal_path(src_prj_path, false);
+	}();
+	static const std::vector<std::string> moved_windows_dir = []() {
+		std::string src_prj_path{ "Y:\\mnt\\ws" };
+		return convert_to_internal_path(src_prj_path, true);
+	}();
+
+	check_path(path, posix_dir, moved_posix_dir);
+	check_path(path, windows_dir, moved_windows_dir);
+	check_path(path, share_dir, windows_dir);
+}
+
+void check_input(const std::string &path) {
+	check_split_path(path);
+	check_is_valid_path(path);
+	check_normalize_path(path);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size) {
+	const std::string input(reinterpret_cast<const char *>(data), size);
+#if defined(RESOLVE_PATH_FUZZ_SPLIT_PATH)
+	check_split_path(input);
+#elif defined(RESOLVE_PATH_FUZZ_IS_VALID_PATH)
+	check_is_valid_path(input);
+#elif defined(RESOLVE_PATH_FUZZ_NORMALIZE_PATH)
+	check_normalize_path(input);
+#else
+	check_input(input);
+#endif
+	return 0;
+}
+
+#ifndef RESOLVE_PATH_LIBFUZZER
+// Paths are glued together from these so that random inputs hit separator runs,
+// dot segments, drives, shares and invalid names far more often than random bytes would.
+std::string random_path(std::mt19937 &rng) {
+	static const char *const pieces[] = { "a", "b", "abc", ".", "..", "...", "/", "\\", "//", "\\\\", "C:", "c:", "Z:", "\\\\?\\", "\\\\.\\", "UNC", " ", "a.", "*", "?", "|", ":", "con", "Lpt1.", "nul.txt",
+		"generated_include-2", "\t", "\xE9", "<\">", "@" };
+	std::uniform_int_distribution<std::size_t> piece_count{ 0, 12 };
+	std::uniform_int_distribution<std::size_t> piece_index{ 0, sizeof(pieces) / sizeof(pieces[0]) - 1 };
+
+	std::string path;
+	for (std::size_t i = piece_count(rng); i > 0; --i) {
+		path.append(pieces[piece_index(rng)]);
+	}
+	return path;
+}
+
+const char usage[] =
+	"usage: fuzz_resolve_path [-runs=<n>] [<file or directory>...]\n"
+	"  -runs=<n>               check n random paths, 200000 without inputs and 0 with them\n"
+	"  <file or directory>...  replay the files, and every file in the directories, first\n";
+
+int main(int argc, char *argv[]) {
+	std::vector<const char *> inputs;
+	boost::optional<std::size_t> runs;
+
+	for (int i = 1; i < argc; ++i) {
+		const boost::string_view arg{ argv[i] };
+		if (arg.starts_with("-runs=")) runs = std::strtoull(argv[i] + 6, nullptr, 10);
+		else if (!arg.starts_with("-")) inputs.push_back(argv[i]);
+		else {
+			std::cerr << usage;
+			return 2;
+		}
+	}
+
+	// Replays the inputs like libFuzzer. One that cannot be read fails the run, rather
+	// than passing without checking anything.
+	for (const char *input_name : inputs) {
+		std::vector<boost::filesystem::path> files;
+		if (boost::filesystem::is_directory(input_name)) {
+			files.assign(boost::filesystem::directory_iterator{ input_name }, boost::filesystem::directory_iterator{});
+		}
+		else {
+			files.emplace_back(input_name);
+		}
+
+		for (const boost::filesystem::path &file : files) {
+			std::ifstream input{ file.string(), std::ios::binary };
+			if (!input) {
+				std::cerr << "fuzz_resolve_path: cannot read " << file.string() << "\n";
+				return 2;
+			}
+			check_input(std::string(std::istreambuf_iterator<char>{ input }, std::istreambuf_iterator<char>{}));
+		}
+	}
+
+	std::mt19937 rng{ 5489u };
+	const std::size_t run_count = runs ? *runs : inputs.empty() ? 200000 : 0;
+	for (std::size_t i = 0; i < run_count; ++i) {
+		check_input(random_path(rng));
+	}
+
+	return 0;
+}
+#endif
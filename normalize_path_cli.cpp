@@ -0,0 +1,314 @@
+#include "stdafx.h"
+#include "resolve_path.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+// Normalizes newline or NUL separated paths from files or stdin against --root and
+// writes one result per input record, in order, with the same separator. Paths
+// normalize_path rejects are reported on stderr with their line number and written
+// as empty records, so output line N always belongs to input line N.
+//
+// Reading, normalizing and writing run as a pipeline: a reader thread cuts the input
+// into chunks of complete records, worker threads normalize whole chunks, and the
+// main thread writes the results in input order. Both queues between the stages are
+// bounded, so a slow writer holds back the reader instead of buffering the input.
+
+const char usage[] =
+	"usage: normalize_path --root <dir> [-0] [--threads <n>] [--stats] [<file>...]\n"
+	"  --root <dir>     project directory, as accepted by convert_to_internal_path\n"
+	"  -0               records are NUL separated instead of newline separated\n"
+	"  --threads <n>    normalize on n threads, all threads of the machine if 0 (default)\n"
+	"  --stats          write counters to stderr at the end, if built with RESOLVE_PATH_STATS\n"
+	"  <file>...        memory mapped and read in order instead of stdin\n";
+
+const std::size_t chunk_size = 4 << 20;
+
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(std::size_t capacity) : m_capacity{ capacity } {}
+
+	// Blocks while the queue is full. Once it is closed the value is dropped and false returned.
+	bool push(T value) {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_not_full.wait(lock, [this]() { return m_is_closed || m_items.size() < m_capacity; });
+		if (m_is_closed) return false;
+
+		m_items.push_back(std::move(value));
+		m_not_empty.notify_one();
+		return true;
+	}
+
+	// Blocks while the queue is empty, boost::none once it is closed and drained.
+	boost::optional<T> pop() {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_not_empty.wait(lock, [this]() { return m_is_closed || !m_items.empty(); });
+		if (m_items.empty()) return boost::none;
+
+		boost::optional<T> value{ std::move(m_items.front()) };
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return value;
+	}
+
+	void close() {
+		const std::lock_guard<std::mutex> lock{ m_mutex };
+		m_is_closed = true;
+		m_not_empty.notify_all();
+		m_not_full.notify_all();
+	}
+
+private:
+	const std::size_t m_capacity;
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+	std::deque<T> m_items;
+	bool m_is_closed = false;
+};
+
+struct OutputChunk {
+	std::string data;
+	std::size_t record_count = 0;
+	// The index in the chunk and the text of every record normalize_path rejected.
+	std::vector<std::pair<std::size_t, std::string>> invalid_paths;
+};
+
+// Complete records, and whatever keeps their memory alive: the mapping of a file or
+// the buffer read from stdin.
+struct InputChunk {
+	std::shared_ptr<const void> owner;
+	boost::string_view data;
+	std::promise<OutputChunk> output;
+};
+
+class Pipeline {
+public:
+	Pipeline(const ProjectRoot &root, char separator, std::size_t thread_count)
+		: m_root{ root }, m_separator{ separator },
+		m_worker_count{ thread_count != 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency()) },
+		m_chunks{ 2 * m_worker_count }, m_outputs{ 2 * m_worker_count + 2 } {}
+
+	// Returns the number of invalid paths.
+	std::size_t run(const std::vector<const char *> &file_names) {
+		std::exception_ptr read_error;
+		std::thread reader{ [&]() {
+			try {
+				if (file_names.empty()) read_stdin();
+				for (const char *file_name : file_names) read_mapped_file(file_name);
+			}
+			catch (...) {
+				read_error = std::current_exception();
+			}
+			m_chunks.close();
+			m_outputs.close();
+		} };
+
+		std::vector<std::thread> workers;
+		for (std::size_t i = 0; i < m_worker_count; ++i) {
+			workers.emplace_back([this]() { normalize_chunks(); });
+		}
+
+		std::exception_ptr write_error;
+		try {
+			write_outputs();
+		}
+		catch (...) {
+			write_error = std::current_exception();
+			m_chunks.close();
+			m_outputs.close();
+		}
+
+		reader.join();
+		for (std::thread &worker : workers) worker.join();
+
+		if (read_error) std::rethrow_exception(read_error);
+		if (write_error) std::rethrow_exception(write_error);
+		return m_invalid_count;
+	}
+
+private:
+	// The output is queued before the chunk, so the writer always waits on the oldest chunk.
+	bool push_chunk(std::shared_ptr<const void> owner, boost::string_view data) {
+		InputChunk chunk{ std::move(owner), data, std::promise<OutputChunk>{} };
+		return m_outputs.push(chunk.output.get_future()) && m_chunks.push(std::move(chunk));
+	}
+
+	void read_mapped_file(const char *file_name) {
+		namespace bip = boost::interprocess;
+
+		// Mapping an empty file fails, and there is nothing to read from it anyway.
+		if (boost::filesystem::file_size(file_name) == 0) return;
+
+		struct MappedFile {
+			bip::file_mapping file;
+			bip::mapped_region region;
+		};
+		const auto mapped_file = std::make_shared<MappedFile>();
+		mapped_file->file = bip::file_mapping{ file_name, bip::read_only };
+		mapped_file->region = bip::mapped_region{ mapped_file->file, bip::read_only };
+		mapped_file->region.advise(bip::mapped_region::advice_sequential);
+
+		const boost::string_view data{ static_cast<const char *>(mapped_file->region.get_address()), mapped_file->region.get_size() };
+		for (std::size_t offset = 0; offset < data.size();) {
+			const std::size_t end = chunk_end(data, offset);
+			if (!push_chunk(mapped_file, data.substr(offset, end - offset))) return;
+			offset = end;
+		}
+	}
+
+	void read_stdin() {
+		std::string carry;
+
+		for (;;) {
+			const auto buffer = std::make_shared<std::string>(std::move(carry));
+			const std::size_t size = buffer->size();
+			buffer->resize(size + chunk_size);
+
+			const std::size_t read = std::fread(&(*buffer)[size], 1, chunk_size, stdin);
+			buffer->resize(size + read);
+			if (std::ferror(stdin)) throw std::runtime_error{ "cannot read stdin" };
+
+			const bool is_last = read < chunk_size;
+			const boost::string_view data{ *buffer };
+			const std::size_t end = is_last ? data.size() : data.rfind(m_separator) + 1;
+
+			// Without a separator in it, the buffer is all one incomplete record.
+			carry.assign(data.data() + end, data.size() - end);
+			if (end > 0 && !push_chunk(buffer, data.substr(0, end))) return;
+			if (is_last) return;
+		}
+	}
+
+	// Ends a chunk starting at offset after the last separator within chunk_size, or
+	// after the first one beyond it for records longer than that.
+	std::size_t chunk_end(boost::string_view data, std::size_t offset) const {
+		if (data.size() - offset <= chunk_size) return data.size();
+
+		const std::size_t last = data.substr(offset, chunk_size).rfind(m_separator);
+		if (last != boost::string_view::npos) return offset + last + 1;
+
+		const std::size_t next = data.find(m_separator, offset + chunk_size);
+		return next != boost::string_view::npos ? next + 1 : data.size();
+	}
+
+	void normalize_chunks() {
+		std::string normalized_path;
+
+		while (boost::optional<InputChunk> chunk = m_chunks.pop()) {
+			try {
+				chunk->output.set_value(normalize_chunk(chunk->data, normalized_path));
+			}
+			catch (...) {
+				chunk->output.set_exception(std::current_exception());
+			}
+		}
+	}
+
+	OutputChunk normalize_chunk(boost::string_view data, std::string &normalized_path) const {
+		OutputChunk output;
+		output.data.reserve(data.size() + data.size() / 2);
+
+		for (std::size_t offset = 0; offset < data.size(); ++output.record_count) {
+			const std::size_t found = data.find(m_separator, offset);
+			const std::size_t end = found != boost::string_view::npos ? found : data.size();
+			boost::string_view path = data.substr(offset, end - offset);
+			if (m_separator == '\n' && !path.empty() && path.back() == '\r') path.remove_suffix(1);
+
+			if (normalize_path(path, m_root, normalized_path)) {
+				output.data.append(normalized_path);
+			}
+			else {
+				output.invalid_paths.emplace_back(output.record_count, path.to_string());
+			}
+			output.data.push_back(m_separator);
+			offset = end + 1;
+		}
+
+		return output;
+	}
+
+	void write_outputs() {
+		std::size_t line = 0;
+
+		while (boost::optional<std::future<OutputChunk>> future = m_outputs.pop()) {
+			const OutputChunk output = future->get();
+			if (std::fwrite(output.data.data(), 1, output.data.size(), stdout) != output.data.size()) {
+				throw std::runtime_error{ "cannot write stdout" };
+			}
+
+			for (const auto &invalid_path : output.invalid_paths) {
+				std::cerr << "line " << line + invalid_path.first + 1 << ": invalid path: " << invalid_path.second << "\n";
+			}
+			line += output.record_count;
+			m_invalid_count += output.invalid_paths.size();
+		}
+
+		// A failed write may only show when the buffer is flushed.
+		if (std::fflush(stdout) != 0 || std::ferror(stdout)) throw std::runtime_error{ "cannot write stdout" };
+	}
+
+	const ProjectRoot &m_root;
+	const char m_separator;
+	const std::size_t m_worker_count;
+
+	BoundedQueue<InputChunk> m_chunks;
+	BoundedQueue<std::future<OutputChunk>> m_outputs;
+	std::size_t m_invalid_count = 0;
+};
+
+int main(int argc, char *argv[]) {
+	std::string src_prj_path;
+	char separator = '\n';
+	std::size_t thread_count = 0;
+	std::vector<const char *> file_names;
+	bool write_stats = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const boost::string_view arg{ argv[i] };
+		if (arg == "--root" && i + 1 < argc) src_prj_path = argv[++i];
+		else if (arg == "-0") separator = '\0';
+		else if (arg == "--threads" && i + 1 < argc) thread_count = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--stats") write_stats = true;
+		else if (!arg.starts_with("-")) file_names.push_back(argv[i]);
+		else {
+			std::cerr << usage;
+			return 2;
+		}
+	}
+
+	const bool is_windows = has_windows_root(src_prj_path);
+	if (src_prj_path.empty() || !is_normalized_path(src_prj_path, is_windows)) {
+		std::cerr << "normalize_path: --root must be a normalized absolute path\n" << usage;
+		return 2;
+	}
+
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	const ProjectRoot root{ convert_to_internal_path(src_prj_path, is_windows) };
+	std::size_t invalid_count = 0;
+
+	try {
+		Pipeline pipeline{ root, separator, thread_count };
+		invalid_count = pipeline.run(file_names);
+	}
+	catch (const std::exception &e) {
+		std::cerr << "normalize_path: " << e.what() << "\n";
+		return 2;
+	}
+
+	if (write_stats) write_path_stats(std::cerr, path_stats_snapshot());
+	return invalid_count == 0 ? 0 : 1;
+}
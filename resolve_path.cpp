@@ -1,82 +1,613 @@
 ﻿#include "stdafx.h"
+#include "resolve_path.h"
+
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#define FORCE_INLINE __forceinline
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+const char *find_separator_scalar(const char *first, const char *last) {
+	for (; first != last && !is_separator(*first); ++first);
+	return first;
+}
 
-#define PRINT_ON 1
-#define PRINT_TEST_ON 0
+#if SIMD_ON == 1
+inline unsigned count_trailing_zeros(unsigned mask) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
 
-std::vector<std::string> split_path(const std::string &path);
+const char *find_separator_sse2(const char *first, const char *last) {
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i backslash = _mm_set1_epi8('\\');
 
-inline bool has_windows_drive(const std::string first_subpath);
-inline bool is_root(const std::string first_subpath, bool is_windows, bool strict);
-bool is_valid_path(const std::string &path, bool is_windows);
-bool is_normalized_path(const std::string &path, bool is_windows);
+	for (; last - first >= 16; first += 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+		const unsigned mask = _mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, slash), _mm_cmpeq_epi8(chunk, backslash)));
+		if (mask != 0) return first + count_trailing_zeros(mask);
+	}
 
-boost::optional<std::string> normalize(const std::vector<std::string> &subpaths, bool is_windows);
-boost::optional<std::string> normalize_path(const std::string &path, const std::vector<std::string> &src_prj_dir);
-std::vector<std::string> convert_to_internal_path(std::string &normalized_path, bool is_windows);
+	return find_separator_scalar(first, last);
+}
 
+TARGET_AVX2 const char *find_separator_avx2(const char *first, const char *last) {
+	const __m256i slash = _mm256_set1_epi8('/');
+	const __m256i backslash = _mm256_set1_epi8('\\');
 
-std::vector<std::string> split_path(const std::string &path) {
-	const static boost::regex split_reg{ "/+|\\\\+" };
+	for (; last - first >= 32; first += 32) {
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+		const unsigned mask = _mm256_movemask_epi8(
+			_mm256_or_si256(_mm256_cmpeq_epi8(chunk, slash), _mm256_cmpeq_epi8(chunk, backslash)));
+		if (mask != 0) return first + count_trailing_zeros(mask);
+	}
+
+	return find_separator_sse2(first, last);
+}
+
+bool has_avx2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	// AVX2 also needs the OS to save the YMM registers, which OSXSAVE and XCR0 report.
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+// Picks the widest kernel the CPU supports the first time it is called.
+const char *find_separator(const char *first, const char *last) {
+	typedef const char *(*find_separator_func)(const char *, const char *);
+
+#if SIMD_ON == 1
+	static const find_separator_func func = has_avx2() ? find_separator_avx2 : find_separator_sse2;
+#else
+	static const find_separator_func func = find_separator_scalar;
+#endif
 
+	return func(first, last);
+}
+
+// Calls func on every subpath of path, starting with a "/" root subpath if path
+// starts with a separator. Stops early, returning false, when func returns false.
+// Forced inline so that func, usually a lambda, gets inlined into the loop with it.
+template <typename Func>
+FORCE_INLINE bool for_each_subpath(boost::string_view path, Func func) {
 	std::size_t path_size = path.size();
-	std::vector<std::string> split_path;
 
 	std::size_t offset = 0;
-	for (; offset < path_size && (path[offset] == '/' || path[offset] == '\\'); ++offset);
+	for (; offset < path_size && is_separator(path[offset]); ++offset);
+
+	if (offset > 0 && !func(boost::string_view{ "/" })) return false;
 
-	if (offset > 0) split_path.emplace_back("/");
+	// A separator run only spans one kind of separator, so a mixed run such
+	// as "/\\" yields an empty subpath in between. A trailing run yields nothing.
+	while (offset < path_size) {
+		// Most subpaths are short, so only long tails are worth a call into a SIMD kernel.
+		std::size_t sep = offset;
+		if (path_size - offset < 16) {
+			for (; sep < path_size && !is_separator(path[sep]); ++sep);
+		}
+		else {
+			sep = find_separator(path.data() + offset, path.data() + path_size) - path.data();
+		}
 
-	std::copy(
-		boost::sregex_token_iterator(path.begin() + offset, path.end(), split_reg, -1),
-		boost::sregex_token_iterator(),
-		std::back_inserter(split_path));
+		if (!func(path.substr(offset, sep - offset))) return false;
+		if (sep == path_size) break;
 
-	return split_path;
+		const char sep_char = path[sep];
+		for (offset = sep; offset < path_size && path[offset] == sep_char; ++offset);
+	}
+
+	return true;
 }
 
-inline bool has_windows_drive(const std::string first_subpath) {
-	return first_subpath.size() == 2 &&
-		std::isupper(first_subpath[0]) &&
-		first_subpath[1] == ':';
+constexpr std::uint8_t SubpathChars::flags[256];
+
+// The first character from first on that ends a subpath of Flavor or cannot be in one,
+// the only ones for_each_checked_subpath needs to look up.
+template <typename Flavor>
+const char *find_checked_char_scalar(const char *first, const char *last) {
+	for (; first != last && (SubpathChars::of(*first) & (Flavor::separator_chars | Flavor::invalid_chars)) == 0; ++first);
+	return first;
 }
 
-inline bool is_root(const std::string first_subpath, bool is_windows, bool strict) {
-	bool has_root = false;
-	
-	if (!strict || !is_windows) {
-		has_root = first_subpath == "/";
+#if SIMD_ON == 1
+// Masks of the characters of a chunk that find_checked_char stops at. For POSIX paths
+// that is everything outside of [A-Za-z0-9._-], for Windows paths the separators,
+// control characters and "*:<>?|.
+inline unsigned checked_char_mask_sse2(PosixFlavor, __m128i chunk) {
+	const __m128i letter = _mm_sub_epi8(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	const __m128i digit = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+	__m128i portable = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8('z' - 'a')), letter);
+	portable = _mm_or_si128(portable, _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8('9' - '0')), digit));
+	portable = _mm_or_si128(portable, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('.')));
+	portable = _mm_or_si128(portable, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+	portable = _mm_or_si128(portable, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('-')));
+	return ~static_cast<unsigned>(_mm_movemask_epi8(portable)) & 0xFFFF;
+}
+
+inline unsigned checked_char_mask_sse2(WindowsFlavor, __m128i chunk) {
+	__m128i special = _mm_cmpeq_epi8(_mm_min_epu8(chunk, _mm_set1_epi8(0x1F)), chunk);
+	for (const char c : { '/', '\\', '"', '*', ':', '<', '>', '?', '|' }) {
+		special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
 	}
-	has_root = has_root ||
-			(is_windows && has_windows_drive(first_subpath));
+	return static_cast<unsigned>(_mm_movemask_epi8(special));
+}
 
-	return has_root;
+TARGET_AVX2 inline unsigned checked_char_mask_avx2(PosixFlavor, __m256i chunk) {
+	const __m256i letter = _mm256_sub_epi8(_mm256_or_si256(chunk, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	const __m256i digit = _mm256_sub_epi8(chunk, _mm256_set1_epi8('0'));
+	__m256i portable = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8('z' - 'a')), letter);
+	portable = _mm256_or_si256(portable, _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8('9' - '0')), digit));
+	portable = _mm256_or_si256(portable, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('.')));
+	portable = _mm256_or_si256(portable, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_')));
+	portable = _mm256_or_si256(portable, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('-')));
+	return ~static_cast<unsigned>(_mm256_movemask_epi8(portable));
 }
 
-bool is_valid_path(const std::string &path, bool is_windows) {
-	if (!is_windows && path.find("\\") != std::string::npos) return false;
+TARGET_AVX2 inline unsigned checked_char_mask_avx2(WindowsFlavor, __m256i chunk) {
+	__m256i special = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, _mm256_set1_epi8(0x1F)), chunk);
+	for (const char c : { '/', '\\', '"', '*', ':', '<', '>', '?', '|' }) {
+		special = _mm256_or_si256(special, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c)));
+	}
+	return static_cast<unsigned>(_mm256_movemask_epi8(special));
+}
+
+template <typename Flavor>
+const char *find_checked_char_sse2(const char *first, const char *last) {
+	for (; last - first >= 16; first += 16) {
+		const unsigned mask = checked_char_mask_sse2(Flavor{}, _mm_loadu_si128(reinterpret_cast<const __m128i *>(first)));
+		if (mask != 0) return first + count_trailing_zeros(mask);
+	}
 
-	std::vector<std::string> sub_paths = split_path(path);
-	if (sub_paths.empty()) return false;
+	return find_checked_char_scalar<Flavor>(first, last);
+}
+
+template <typename Flavor>
+TARGET_AVX2 const char *find_checked_char_avx2(const char *first, const char *last) {
+	for (; last - first >= 32; first += 32) {
+		const unsigned mask = checked_char_mask_avx2(Flavor{}, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first)));
+		if (mask != 0) return first + count_trailing_zeros(mask);
+	}
+
+	return find_checked_char_sse2<Flavor>(first, last);
+}
+#endif
 
-	bool has_root = is_root(sub_paths[0], is_windows, false);
+template <typename Flavor>
+const char *find_checked_char(const char *first, const char *last) {
+	typedef const char *(*find_checked_char_func)(const char *, const char *);
+
+#if SIMD_ON == 1
+	static const find_checked_char_func func = has_avx2() ? find_checked_char_avx2<Flavor> : find_checked_char_sse2<Flavor>;
+#else
+	static const find_checked_char_func func = find_checked_char_scalar<Flavor>;
+#endif
+
+	return func(first, last);
+}
+
+// for_each_subpath for the validating functions. Only Flavor::separator_chars separate
+// subpaths, and func also gets whether all characters of the subpath are valid, which
+// is collected in the same table lookups that look for the next separator. A Windows
+// path starting with exactly two separators starts with a share or device root, which
+// is passed on as one subpath, valid if it has all of its names.
+template <typename Flavor, typename Func>
+FORCE_INLINE bool for_each_checked_subpath(boost::string_view path, Func func) {
+	const char *data = path.data();
+	std::size_t path_size = path.size();
+
+	std::size_t offset = 0;
+	if (Flavor::is_windows && path_size > 2 && is_separator(data[0]) && is_separator(data[1]) && !is_separator(data[2])) {
+		const WindowsRoot root = parse_windows_root(path);
+		if (!func(path.substr(0, root.size), root.kind != WindowsRoot::Kind::invalid)) return false;
+
+		offset = root.size;
+		if (offset < path_size) {
+			const char sep_char = data[offset];
+			for (; offset < path_size && data[offset] == sep_char; ++offset);
+		}
+	}
+	else {
+		for (; offset < path_size && (SubpathChars::of(data[offset]) & Flavor::separator_chars); ++offset);
+		if (offset > 0 && !func(boost::string_view{ "/" }, true)) return false;
+	}
+
+	// Looks up the characters of [sep, last) in the table until a separator, and collects
+	// their flags.
+	auto scan_chars = [data](std::size_t sep, std::size_t last, std::uint8_t &flags) {
+		for (; sep < last; ++sep) {
+			const std::uint8_t char_flags = SubpathChars::of(data[sep]);
+			if (char_flags & Flavor::separator_chars) break;
+			flags |= char_flags;
+		}
+		return sep;
+	};
+
+	while (offset < path_size) {
+		// Most subpaths, such as "..", are short, so the table is tried on the first 16
+		// characters, and only a subpath that goes on past them is worth a call into a
+		// SIMD kernel. It skips to the separator unless an invalid character comes first,
+		// which the table then looks up and carries on from.
+		std::uint8_t flags = 0;
+		const std::size_t short_end = std::min(path_size, offset + 16);
+		std::size_t sep = scan_chars(offset, short_end, flags);
+		if (sep == short_end && path_size - sep >= 16) sep = find_checked_char<Flavor>(data + sep, data + path_size) - data;
+		sep = scan_chars(sep, path_size, flags);
+
+		if (!func(path.substr(offset, sep - offset), (flags & Flavor::invalid_chars) == 0)) return false;
+		if (sep == path_size) break;
+
+		const char sep_char = data[sep];
+		for (offset = sep; offset < path_size && data[offset] == sep_char; ++offset);
+	}
 
-	std::size_t offset = (has_root ? 1 : 0);
-	return std::all_of(sub_paths.begin() + offset, sub_paths.end(),
-		[is_windows](const std::string &sub_path) {
-		return (!is_windows && boost::filesystem::portable_posix_name(sub_path)) ||
-			(is_windows && boost::filesystem::windows_name(sub_path));
+	return true;
+}
+
+// "C:foo", a drive not followed by a separator, as the first subpath of a Windows path.
+inline bool is_drive_relative(boost::string_view first_subpath) {
+	return first_subpath.size() > 2 && first_subpath[1] == ':' && is_drive_letter(first_subpath[0]);
+}
+
+// Whether first_subpath is a root exactly as normalize_path writes it.
+template <typename Flavor>
+bool is_normalized_root(boost::string_view first_subpath) {
+	if (!Flavor::is_windows) return Flavor::is_root(first_subpath, true);
+
+	const WindowsRoot root = parse_windows_root(first_subpath);
+	return root.size == first_subpath.size() && root.is_normalized(first_subpath);
+}
+
+// The drive or share root of first_subpath as normalize_path writes it: first_subpath
+// itself if it is written that way already, or what is appended to buffer otherwise.
+template <typename Buffer>
+boost::string_view normalized_windows_root(const WindowsRoot &root, boost::string_view first_subpath, Buffer &buffer) {
+	if (root.is_normalized(first_subpath)) return first_subpath;
+
+	root.append_to(buffer);
+	return boost::string_view{ buffer.data(), buffer.size() };
+}
+
+#ifdef RESOLVE_PATH_STATS
+// The counters of one thread. Only their thread writes them, so a relaxed load and
+// store is enough to count, and snapshots on other threads still read whole values.
+struct ThreadPathStats {
+	struct Counters {
+		std::atomic<std::uint64_t> calls;
+		std::atomic<std::uint64_t> bytes;
+		std::atomic<std::uint64_t> subpaths;
+		std::atomic<std::uint64_t> invalid;
+		std::atomic<std::uint64_t> escaped_root;
+		std::atomic<std::uint64_t> latency_ns[PathStats::latency_buckets];
+		std::atomic<std::uint64_t> latency_ns_sum;
+	};
+
+	static void add(std::atomic<std::uint64_t> &counter, std::uint64_t value) {
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	ThreadPathStats();
+	~ThreadPathStats();
+
+	void add_to(PathStats &stats) const;
+	void reset();
+
+	Counters operations[PathStats::operation_count] = {};
+};
+
+static std::mutex path_stats_mutex;
+static std::vector<const ThreadPathStats *> live_path_stats;
+static PathStats exited_path_stats;
+
+ThreadPathStats::ThreadPathStats() {
+	const std::lock_guard<std::mutex> lock{ path_stats_mutex };
+	live_path_stats.push_back(this);
+}
+
+ThreadPathStats::~ThreadPathStats() {
+	const std::lock_guard<std::mutex> lock{ path_stats_mutex };
+	add_to(exited_path_stats);
+	live_path_stats.erase(std::find(live_path_stats.begin(), live_path_stats.end(), this));
+}
+
+void ThreadPathStats::add_to(PathStats &stats) const {
+	for (std::size_t operation = 0; operation < PathStats::operation_count; ++operation) {
+		const Counters &counters = operations[operation];
+		PathStats::OperationStats &sum = stats.operations[operation];
+		sum.calls += counters.calls.load(std::memory_order_relaxed);
+		sum.bytes += counters.bytes.load(std::memory_order_relaxed);
+		sum.subpaths += counters.subpaths.load(std::memory_order_relaxed);
+		sum.invalid += counters.invalid.load(std::memory_order_relaxed);
+		sum.escaped_root += counters.escaped_root.load(std::memory_order_relaxed);
+		for (std::size_t bucket = 0; bucket < PathStats::latency_buckets; ++bucket) {
+			sum.latency_ns[bucket] += counters.latency_ns[bucket].load(std::memory_order_relaxed);
+		}
+		sum.latency_ns_sum += counters.latency_ns_sum.load(std::memory_order_relaxed);
+	}
+}
+
+void ThreadPathStats::reset() {
+	for (Counters &counters : operations) {
+		counters.calls.store(0, std::memory_order_relaxed);
+		counters.bytes.store(0, std::memory_order_relaxed);
+		counters.subpaths.store(0, std::memory_order_relaxed);
+		counters.invalid.store(0, std::memory_order_relaxed);
+		counters.escaped_root.store(0, std::memory_order_relaxed);
+		for (std::atomic<std::uint64_t> &bucket : counters.latency_ns) bucket.store(0, std::memory_order_relaxed);
+		counters.latency_ns_sum.store(0, std::memory_order_relaxed);
+	}
+}
+
+// Registered with the first counted call of a thread, folded into exited_path_stats
+// when the thread exits.
+static ThreadPathStats &thread_path_stats() {
+	thread_local ThreadPathStats stats;
+	return stats;
+}
+
+// Counts one call of operation when it goes out of scope.
+class PathStatsScope {
+public:
+	PathStatsScope(PathStats::Operation operation, std::size_t bytes)
+		: m_counters{ thread_path_stats().operations[operation] }, m_bytes{ bytes }
+#ifdef RESOLVE_PATH_STATS_LATENCY
+		, m_start{ std::chrono::steady_clock::now() }
+#endif
+	{}
+
+	~PathStatsScope() {
+		ThreadPathStats::add(m_counters.calls, 1);
+		ThreadPathStats::add(m_counters.bytes, m_bytes);
+		ThreadPathStats::add(m_counters.subpaths, m_subpaths);
+		if (m_is_invalid) ThreadPathStats::add(m_escaped_root ? m_counters.escaped_root : m_counters.invalid, 1);
+
+#ifdef RESOLVE_PATH_STATS_LATENCY
+		const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+		const std::uint64_t ns = static_cast<std::uint64_t>(elapsed.count());
+		std::size_t bucket = 0;
+		while (bucket < PathStats::latency_buckets - 1 && (ns >> bucket) != 0) ++bucket;
+		ThreadPathStats::add(m_counters.latency_ns[bucket], 1);
+		ThreadPathStats::add(m_counters.latency_ns_sum, ns);
+#endif
+	}
+
+	void add_subpath() { ++m_subpaths; }
+	void set_subpaths(std::size_t subpaths) { m_subpaths = subpaths; }
+	bool set_valid(bool is_valid) { m_is_invalid = !is_valid; return is_valid; }
+	void set_escaped_root() { m_escaped_root = true; }
+
+private:
+	ThreadPathStats::Counters &m_counters;
+	std::size_t m_bytes;
+	std::size_t m_subpaths = 0;
+	bool m_is_invalid = false;
+	bool m_escaped_root = false;
+#ifdef RESOLVE_PATH_STATS_LATENCY
+	std::chrono::steady_clock::time_point m_start;
+#endif
+};
+
+PathStats path_stats_snapshot() {
+	const std::lock_guard<std::mutex> lock{ path_stats_mutex };
+	PathStats stats = exited_path_stats;
+	for (const ThreadPathStats *thread_stats : live_path_stats) thread_stats->add_to(stats);
+	return stats;
+}
+
+void reset_path_stats() {
+	const std::lock_guard<std::mutex> lock{ path_stats_mutex };
+	exited_path_stats = PathStats{};
+	for (const ThreadPathStats *thread_stats : live_path_stats) const_cast<ThreadPathStats *>(thread_stats)->reset();
+}
+#else
+// Without RESOLVE_PATH_STATS every call on it compiles to nothing.
+class PathStatsScope {
+public:
+	PathStatsScope(PathStats::Operation, std::size_t) {}
+
+	void add_subpath() {}
+	void set_subpaths(std::size_t) {}
+	bool set_valid(bool is_valid) { return is_valid; }
+	void set_escaped_root() {}
+};
+
+PathStats path_stats_snapshot() {
+	return PathStats{};
+}
+
+void reset_path_stats() {}
+#endif
+
+void write_path_stats(std::ostream &out, const PathStats &stats) {
+	static const char *const operation_names[] = { "split", "validate", "normalize" };
+
+	const auto write_counter = [&out, &stats](const char *name, std::uint64_t PathStats::OperationStats::*counter) {
+		out << "# TYPE resolve_path_" << name << "_total counter\n";
+		for (std::size_t operation = 0; operation < PathStats::operation_count; ++operation) {
+			out << "resolve_path_" << name << "_total{operation=\"" << operation_names[operation] << "\"} "
+				<< stats.operations[operation].*counter << "\n";
+		}
+	};
+
+	write_counter("calls", &PathStats::OperationStats::calls);
+	write_counter("bytes", &PathStats::OperationStats::bytes);
+	write_counter("subpaths", &PathStats::OperationStats::subpaths);
+	write_counter("invalid", &PathStats::OperationStats::invalid);
+	write_counter("escaped_root", &PathStats::OperationStats::escaped_root);
+
+	out << "# TYPE resolve_path_latency_ns histogram\n";
+	for (std::size_t operation = 0; operation < PathStats::operation_count; ++operation) {
+		const PathStats::OperationStats &operation_stats = stats.operations[operation];
+		std::uint64_t count = 0;
+		for (std::size_t bucket = 0; bucket < PathStats::latency_buckets; ++bucket) {
+			count += operation_stats.latency_ns[bucket];
+			out << "resolve_path_latency_ns_bucket{operation=\"" << operation_names[operation] << "\",le=\"";
+			if (bucket + 1 < PathStats::latency_buckets) out << ((std::uint64_t{ 1 } << bucket) - 1);
+			else out << "+Inf";
+			out << "\"} " << count << "\n";
+		}
+		out << "resolve_path_latency_ns_sum{operation=\"" << operation_names[operation] << "\"} " << operation_stats.latency_ns_sum << "\n";
+		out << "resolve_path_latency_ns_count{operation=\"" << operation_names[operation] << "\"} " << count << "\n";
+	}
+}
+
+std::vector<std::string> split_path(const std::string &path) {
+	PathStatsScope stats{ PathStats::split, path.size() };
+	std::vector<std::string> split_path;
+
+	for_each_subpath(path, [&split_path](boost::string_view subpath) {
+		split_path.emplace_back(subpath.data(), subpath.size());
+		return true;
 	});
+
+	stats.set_subpaths(split_path.size());
+	return split_path;
 }
 
-bool is_normalized_path(const std::string &path, bool is_windows) {
-	if (!is_valid_path(path, is_windows)) return false;
+void split_path(boost::string_view path, std::vector<boost::string_view> &subpaths) {
+	PathStatsScope stats{ PathStats::split, path.size() };
+	subpaths.clear();
+
+	for_each_subpath(path, [&subpaths](boost::string_view subpath) {
+		subpaths.emplace_back(subpath);
+		return true;
+	});
+
+	stats.set_subpaths(subpaths.size());
+}
 
-	std::vector<std::string> sub_paths = split_path(path);
+boost::container::pmr::vector<boost::container::pmr::string> split_path(boost::string_view path, boost::container::pmr::memory_resource &resource) {
+	PathStatsScope stats{ PathStats::split, path.size() };
+	// The vector hands its allocator on to every string it constructs.
+	boost::container::pmr::vector<boost::container::pmr::string> split_path{ &resource };
 
-	if (!is_root(sub_paths[0], is_windows, true)) return false;
+	for_each_subpath(path, [&split_path](boost::string_view subpath) {
+		split_path.emplace_back(subpath.data(), subpath.size());
+		return true;
+	});
+
+	stats.set_subpaths(split_path.size());
+	return split_path;
+}
+
+template <typename Flavor>
+bool is_valid_path(boost::string_view path) {
+	PathStatsScope stats{ PathStats::validate, path.size() };
+	bool is_first = true;
+	const bool is_valid = for_each_checked_subpath<Flavor>(path, [&](boost::string_view subpath, bool is_valid_chars) {
+		stats.add_subpath();
+		if (is_first) {
+			is_first = false;
+			if (Flavor::is_root(subpath, false)) return true;
+			// Whether the drive is that of the project directory is up to normalize_path.
+			if (Flavor::is_windows && is_drive_relative(subpath)) return Flavor::is_valid_subpath(subpath.substr(2));
+		}
+		return is_valid_chars && Flavor::is_valid_name(subpath);
+	});
+
+	return stats.set_valid(is_valid && !is_first);
+}
+
+template bool is_valid_path<PosixFlavor>(boost::string_view path);
+template bool is_valid_path<WindowsFlavor>(boost::string_view path);
+
+bool is_valid_path(const std::string &path, bool is_windows) {
+	return is_windows ? is_valid_path<WindowsFlavor>(path) : is_valid_path<PosixFlavor>(path);
+}
+
+// The number of subpaths of path, counting its root, if path is exactly what
+// normalize_path writes, and 0 otherwise. A single scan over the characters that gives
+// up at the first character such a path cannot have, so on the paths it accepts it
+// is cheaper than tokenizing.
+template <typename Flavor>
+FORCE_INLINE std::size_t count_canonical_subpaths(boost::string_view path) {
+	const char *iter = path.data();
+	const char *last = iter + path.size();
+
+	if (Flavor::is_windows) {
+		const WindowsRoot root = parse_windows_root(path);
+		if (!root.is_normalized(path) || root.size == path.size() || path[root.size] != '/') return 0;
+		iter += root.size + 1;
+	}
+	else {
+		if (path.empty() || path[0] != '/') return 0;
+		iter += 1;
+	}
+
+	std::size_t count = 1;
+	while (iter != last) {
+		const char *first = iter;
+		std::uint8_t flags = 0;
+		for (; iter != last; ++iter) {
+			const std::uint8_t char_flags = SubpathChars::of(*iter);
+			if (char_flags & SubpathChars::slash) break;
+			flags |= char_flags;
+		}
+
+		// An empty subpath is a doubled or trailing separator.
+		const boost::string_view subpath{ first, static_cast<std::size_t>(iter - first) };
+		if (subpath.empty() || (flags & Flavor::invalid_chars) || !Flavor::is_valid_name(subpath)) return 0;
+		if (subpath[0] == '.' && (subpath.size() == 1 || (subpath.size() == 2 && subpath[1] == '.'))) return 0;
+		++count;
+
+		if (iter != last && ++iter == last) return 0;
+	}
+
+	return count;
+}
 
-	return !std::any_of(sub_paths.begin(), sub_paths.end(),
-		[](const std::string subpath) { return subpath == "." || subpath == ".."; });
+template <typename Flavor>
+bool is_canonical_path(boost::string_view path) {
+	return count_canonical_subpaths<Flavor>(path) != 0;
+}
+
+template bool is_canonical_path<PosixFlavor>(boost::string_view path);
+template bool is_canonical_path<WindowsFlavor>(boost::string_view path);
+
+bool is_canonical_path(const std::string &path, bool is_windows) {
+	return is_windows ? is_canonical_path<WindowsFlavor>(path) : is_canonical_path<PosixFlavor>(path);
+}
+
+template <typename Flavor>
+bool is_normalized_path(boost::string_view path) {
+	// Normalized paths are nearly always canonical too, so only the others are tokenized.
+	if (count_canonical_subpaths<Flavor>(path) != 0) return true;
+
+	bool is_first = true;
+	const bool is_normalized = for_each_checked_subpath<Flavor>(path, [&is_first](boost::string_view subpath, bool is_valid_chars) {
+		if (is_first) {
+			is_first = false;
+			return is_normalized_root<Flavor>(subpath);
+		}
+		return is_valid_chars && Flavor::is_valid_name(subpath) && subpath != "." && subpath != "..";
+	});
+
+	return is_normalized && !is_first;
+}
+
+template bool is_normalized_path<PosixFlavor>(boost::string_view path);
+template bool is_normalized_path<WindowsFlavor>(boost::string_view path);
+
+bool is_normalized_path(const std::string &path, bool is_windows) {
+	return is_windows ? is_normalized_path<WindowsFlavor>(path) : is_normalized_path<PosixFlavor>(path);
 }
 
 boost::optional<std::string> normalize(const std::vector<std::string> &subpaths, bool is_windows) {
@@ -104,14 +635,14 @@ boost::optional<std::string> normalize(const std::vector<std::string> &subpaths,
 	if (parent_counter == 0) {
 		std::string normalized_path;
 		if (is_windows) {
-			normalized_path = subpaths[0];
+			parse_windows_root(subpaths[0]).append_to(normalized_path);
 		}
 		normalized_path.append("/");
 
 		std::for_each(
 			normalized_path_vec.rbegin(),
 			normalized_path_vec.rend(),
-			[&normalized_path](const std::string subpath) {
+			[&normalized_path](const std::string &subpath) {
 				normalized_path.append(subpath);
 				normalized_path.append("/");
 		});
@@ -126,509 +657,1239 @@ boost::optional<std::string> normalize(const std::vector<std::string> &subpaths,
 	return ret_opt;
 }
 
+// The root of the src_prj_dir the legacy overloads were last called with on this thread.
+// Callers pass the same one over and over, and building a root allocates and takes an
+// id from a counter shared by all threads.
+static const ProjectRoot &cached_project_root(const std::vector<std::string> &src_prj_dir) {
+	thread_local std::vector<std::string> cached_dir;
+	thread_local boost::optional<ProjectRoot> cached_root;
+
+	if (!cached_root || cached_dir != src_prj_dir) {
+		cached_root = ProjectRoot{ src_prj_dir };
+		cached_dir = src_prj_dir;
+	}
+	return *cached_root;
+}
+
 boost::optional<std::string> normalize_path(const std::string &path, const std::vector<std::string> &src_prj_dir) {
-	assert(!src_prj_dir.empty());
-	const bool is_windows = has_windows_drive(src_prj_dir[0]);
-	assert(is_root(src_prj_dir[0], is_windows, true));
+	return normalize_path(path, cached_project_root(src_prj_dir));
+}
 
+boost::optional<std::string> normalize_path(const std::string &path, const ProjectRoot &root) {
 	boost::optional<std::string> ret_opt;
-	std::vector<std::string> subpaths = split_path(path);
+	std::string normalized_path;
+
+	if (normalize_path(boost::string_view{ path }, root, normalized_path)) {
+		ret_opt = std::move(normalized_path);
+	}
 
-	if (!subpaths.empty()) {
-		if (is_valid_path(path, is_windows)) {
-			const bool has_root = is_root(subpaths[0], is_windows, true);
+	return ret_opt;
+}
 
-			if (!has_root) {
-				if (is_windows && subpaths[0] == "/") {
-					subpaths[0] = src_prj_dir[0];
-					ret_opt = normalize(subpaths, is_windows);
+template <typename String>
+bool normalize_into(const std::vector<boost::string_view> &subpaths, bool is_windows, String &normalized_path) {
+	assert(is_root(subpaths[0], is_windows, true));
+
+	// The first pass only sizes the result. The second pass writes the kept
+	// subpaths back to front, so they never need to be collected anywhere.
+	std::size_t parent_counter = 0;
+	std::size_t kept_count = 0;
+	std::size_t kept_size = 0;
+
+	for (auto iter = subpaths.rbegin(); iter != subpaths.rend() - 1; ++iter) {
+		if (*iter == ".") {
+			continue;
+		}
+		else if (*iter == "..") {
+			++parent_counter;
+		}
+		else if (parent_counter == 0) {
+			++kept_count;
+			kept_size += iter->size();
+		}
+		else {
+			--parent_counter;
+		}
+	}
+
+	if (parent_counter != 0) return false;
+
+	boost::container::small_vector<char, 64> drive_buffer;
+	const boost::string_view drive = is_windows ? normalized_windows_root(parse_windows_root(subpaths[0]), subpaths[0], drive_buffer) : boost::string_view{};
+	const std::size_t root_size = drive.size() + 1;
+
+	normalized_path.resize(root_size + kept_size + (kept_count > 0 ? kept_count - 1 : 0));
+	std::copy(drive.begin(), drive.end(), &normalized_path[0]);
+	normalized_path[drive.size()] = '/';
+
+	char *out = &normalized_path[0] + normalized_path.size();
+	for (auto iter = subpaths.rbegin(); kept_count > 0; ++iter) {
+		if (*iter == ".") {
+			continue;
+		}
+		else if (*iter == "..") {
+			++parent_counter;
+		}
+		else if (parent_counter == 0) {
+			out -= iter->size();
+			std::copy(iter->begin(), iter->end(), out);
+			if (--kept_count > 0) *--out = '/';
+		}
+		else {
+			--parent_counter;
+		}
+	}
+
+	return true;
+}
+
+bool normalize(const std::vector<boost::string_view> &subpaths, bool is_windows, std::string &normalized_path) {
+	return normalize_into(subpaths, is_windows, normalized_path);
+}
+
+bool normalize(const std::vector<boost::string_view> &subpaths, bool is_windows, boost::container::pmr::string &normalized_path) {
+	return normalize_into(subpaths, is_windows, normalized_path);
+}
+
+bool normalize_path(boost::string_view path, const std::vector<std::string> &src_prj_dir, std::string &normalized_path) {
+	return normalize_path(path, cached_project_root(src_prj_dir), normalized_path);
+}
+
+static std::atomic<std::uint64_t> next_project_root_id{ 0 };
+
+static const std::uint64_t fnv_offset_basis = 14695981039346656037ull;
+static const std::uint64_t fnv_prime = 1099511628211ull;
+
+static std::uint64_t hash_append(std::uint64_t hash, char c) {
+	return (hash ^ static_cast<unsigned char>(c)) * fnv_prime;
+}
+
+static std::uint64_t hash_append(std::uint64_t hash, boost::string_view data) {
+	for (const char c : data) hash = hash_append(hash, c);
+	return hash;
+}
+
+std::uint64_t normalized_path_hash(boost::string_view normalized_path) {
+	return hash_append(fnv_offset_basis, normalized_path);
+}
+
+ProjectRoot::ProjectRoot(const std::vector<std::string> &src_prj_dir)
+	: m_id{ next_project_root_id++ },
+	m_is_windows{ !src_prj_dir.empty() && has_windows_root(src_prj_dir[0]) } {
+	assert(!src_prj_dir.empty());
+	assert(is_root(src_prj_dir[0], m_is_windows, true));
+
+	if (m_is_windows) {
+		parse_windows_root(src_prj_dir[0]).append_to(m_path);
+	}
+	m_path.push_back('/');
+	m_ends.push_back(m_path.size());
+
+	for (auto iter = src_prj_dir.begin() + 1; iter != src_prj_dir.end(); ++iter) {
+		assert(is_valid_subpath(*iter, m_is_windows) && *iter != "." && *iter != "..");
+		if (m_path.size() > m_ends[0]) m_path.push_back('/');
+		m_path.append(*iter);
+		m_ends.push_back(m_path.size());
+	}
+
+	// Every truncated directory is a prefix of the next one, so one pass hashes them all.
+	std::uint64_t hash = fnv_offset_basis;
+	std::size_t hashed_size = 0;
+	for (const std::size_t end : m_ends) {
+		hash = hash_append(hash, boost::string_view{ m_path }.substr(hashed_size, end - hashed_size));
+		hashed_size = end;
+		m_hashes.push_back(hash);
+	}
+}
+
+// Validates, resolves "." and ".." and hands the result to output in a single forward
+// pass. Output provides assign_root, push_subpath and pop_subpath, where pop_subpath
+// fails if only the root is left, which is where the reverse pass of normalize would
+// end up non-zero. Until the first subpath is pushed the result is only tracked as a
+// depth into the root, so leading ".." cost nothing and the root is assigned once.
+// assign_root is also told what that depth is relative to. The drive it is given is
+// the Windows root as normalize_path writes it, which only lives as long as the call.
+template <typename Flavor, typename Output>
+bool normalize_subpaths(boost::string_view path, const ProjectRoot &root, Output &output) {
+	assert(root.is_windows() == Flavor::is_windows);
+
+	PathStatsScope stats{ PathStats::normalize, path.size() };
+	if (path.empty()) return stats.set_valid(false);
+
+	boost::string_view drive = root.drive();
+	boost::container::small_vector<char, 64> drive_buffer;
+	std::size_t root_depth = root.depth();
+	bool has_root = false;
+	RebasablePath::Anchor anchor = RebasablePath::Anchor::project;
+	bool is_first = true;
+
+	const bool is_valid = for_each_checked_subpath<Flavor>(path, [&](boost::string_view subpath, bool is_valid_chars) {
+		stats.add_subpath();
+		if (is_first) {
+			is_first = false;
+
+			// A Windows path starting with a separator is on the drive of the project directory.
+			if (PosixFlavor::is_root(subpath, false)) {
+				root_depth = 0;
+				anchor = Flavor::is_windows ? RebasablePath::Anchor::drive : RebasablePath::Anchor::absolute;
+				return true;
+			}
+
+			if (Flavor::is_windows) {
+				const WindowsRoot windows_root = parse_windows_root(subpath);
+				const bool is_root = windows_root.size == subpath.size() &&
+					(windows_root.kind == WindowsRoot::Kind::drive || windows_root.kind == WindowsRoot::Kind::share);
+				if (is_root) {
+					drive = normalized_windows_root(windows_root, subpath, drive_buffer);
+					root_depth = 0;
+					anchor = RebasablePath::Anchor::absolute;
+					return true;
 				}
-				else {
-					std::vector<std::string> merged_subpaths;
-					merged_subpaths.reserve(src_prj_dir.size() + subpaths.size());
-					merged_subpaths.insert(merged_subpaths.end(), src_prj_dir.begin(), src_prj_dir.end());
-					merged_subpaths.insert(merged_subpaths.end(), subpaths.begin(), subpaths.end());
-					ret_opt = normalize(merged_subpaths, is_windows);
+
+				// "C:foo" is relative to the project directory, if that is on drive C. There
+				// is no current directory for any other drive to be relative to.
+				if (windows_root.kind == WindowsRoot::Kind::drive_relative) {
+					if (drive.size() != 2 || drive[0] != windows_root.drive_letter) return false;
+
+					subpath.remove_prefix(2);
+					is_valid_chars = Flavor::is_valid_subpath(subpath);
 				}
 			}
-			else {
-				ret_opt = normalize(subpaths, is_windows);
+		}
+
+		if (!is_valid_chars || !Flavor::is_valid_name(subpath)) return false;
+
+		if (subpath == ".") {
+			return true;
+		}
+		else if (subpath == "..") {
+			if (!has_root) {
+				if (root_depth == 0) {
+					stats.set_escaped_root();
+					return false;
+				}
+				--root_depth;
 			}
+			else if (!output.pop_subpath()) {
+				stats.set_escaped_root();
+				return false;
+			}
+		}
+		else {
+			if (!has_root) {
+				output.assign_root(root, drive, root_depth, anchor);
+				has_root = true;
+			}
+			output.push_subpath(subpath);
+		}
+
+		return true;
+	});
+
+	if (is_valid && !has_root) output.assign_root(root, drive, root_depth, anchor);
+	return stats.set_valid(is_valid);
+}
+
+// Writes the normalized path as a string. A ".." truncates it back to its previous separator.
+template <typename String>
+struct NormalizedStringOutput {
+	String &normalized_path;
+	std::size_t root_size;
+
+	void assign_root(const ProjectRoot &root, boost::string_view drive, std::size_t root_depth, RebasablePath::Anchor) {
+		if (root_depth > 0) {
+			const boost::string_view root_path = root.path(root_depth);
+			normalized_path.assign(root_path.data(), root_path.size());
+		}
+		else {
+			normalized_path.assign(drive.data(), drive.size());
+			normalized_path.push_back('/');
+		}
+		root_size = drive.size() + 1;
+	}
+
+	void push_subpath(boost::string_view subpath) {
+		if (normalized_path.size() > root_size) normalized_path.push_back('/');
+		normalized_path.append(subpath.data(), subpath.size());
+	}
+
+	bool pop_subpath() {
+		if (normalized_path.size() == root_size) return false;
+		normalized_path.resize(std::max(normalized_path.rfind('/'), root_size));
+		return true;
+	}
+};
+
+// Counts a canonical path as a call of normalize_path, which it bypasses.
+template <typename Flavor>
+FORCE_INLINE bool is_canonical_input(boost::string_view path) {
+	const std::size_t subpath_count = count_canonical_subpaths<Flavor>(path);
+	if (subpath_count == 0) return false;
+
+	PathStatsScope stats{ PathStats::normalize, path.size() };
+	stats.set_subpaths(subpath_count);
+	return true;
+}
+
+template <typename Flavor>
+bool normalize_path(boost::string_view path, const ProjectRoot &root, std::string &normalized_path) {
+	if (is_canonical_input<Flavor>(path)) {
+		normalized_path.assign(path.data(), path.size());
+		return true;
+	}
+
+	NormalizedStringOutput<std::string> output{ normalized_path, 0 };
+	return normalize_subpaths<Flavor>(path, root, output);
+}
+
+template bool normalize_path<PosixFlavor>(boost::string_view path, const ProjectRoot &root, std::string &normalized_path);
+template bool normalize_path<WindowsFlavor>(boost::string_view path, const ProjectRoot &root, std::string &normalized_path);
+
+bool normalize_path(boost::string_view path, const ProjectRoot &root, std::string &normalized_path) {
+	return root.is_windows() ?
+		normalize_path<WindowsFlavor>(path, root, normalized_path) :
+		normalize_path<PosixFlavor>(path, root, normalized_path);
+}
+
+bool normalize_path(boost::string_view path, const ProjectRoot &root, boost::container::pmr::string &normalized_path) {
+	NormalizedStringOutput<boost::container::pmr::string> output{ normalized_path, 0 };
+	return root.is_windows() ?
+		normalize_subpaths<WindowsFlavor>(path, root, output) :
+		normalize_subpaths<PosixFlavor>(path, root, output);
+}
+
+boost::optional<boost::string_view> normalize_path(boost::string_view path, const ProjectRoot &root, boost::container::pmr::memory_resource &resource) {
+	// Normalizing into scratch first means the resource only ever sees one allocation
+	// of the exact size, instead of the growth steps of a string.
+	thread_local std::string normalized_path;
+	if (!normalize_path(path, root, normalized_path)) return boost::none;
+
+	char *data = static_cast<char *>(resource.allocate(normalized_path.size(), 1));
+	std::copy(normalized_path.begin(), normalized_path.end(), data);
+	return boost::string_view{ data, normalized_path.size() };
+}
+
+// Writes the normalized path over the path it is normalized from. Everything written
+// for a subpath ends before the end of that subpath in the input, so the tokenizer
+// never reads a byte that was already overwritten.
+struct InPlaceOutput {
+	char *data;
+	std::size_t size;
+	std::size_t root_size;
+
+	void assign_root(const ProjectRoot &root, boost::string_view drive, std::size_t root_depth, RebasablePath::Anchor) {
+		if (root_depth > 0) {
+			const boost::string_view root_path = root.path(root_depth);
+			std::copy(root_path.begin(), root_path.end(), data);
+			size = root_path.size();
+		}
+		else {
+			// The drive may be the start of data itself, and std::copy must not copy a
+			// range onto itself. Otherwise it lies ahead of data, as subpaths do.
+			if (drive.data() != data) std::copy(drive.begin(), drive.end(), data);
+			data[drive.size()] = '/';
+			size = drive.size() + 1;
 		}
+		root_size = drive.size() + 1;
 	}
 
+	void push_subpath(boost::string_view subpath) {
+		if (size > root_size) data[size++] = '/';
+		// A subpath that nothing before it changed is already in place.
+		if (subpath.data() != data + size) std::copy(subpath.begin(), subpath.end(), data + size);
+		size += subpath.size();
+	}
+
+	bool pop_subpath() {
+		if (size == root_size) return false;
+		while (size > root_size && data[--size] != '/');
+		return true;
+	}
+};
+
+// Where a path has to be moved to before it can be normalized in place: 0 for paths
+// with a root of their own, past the longest prefix of the root for the others.
+static std::size_t in_place_offset(boost::string_view path, const ProjectRoot &root) {
+	if (root.is_windows()) {
+		if (has_windows_root(path)) return 0;
+	}
+	else if (!path.empty() && path[0] == '/') {
+		return 0;
+	}
+	return root.path().size() + 1;
+}
+
+std::size_t normalize_path_in_place_capacity(boost::string_view path, const ProjectRoot &root) {
+	const std::size_t offset = in_place_offset(path, root);
+	if (offset != 0 || !root.is_windows()) return offset + path.size();
+
+	// A Windows root is never longer normalized, but a bare one gains a separator, "C:" to "C:/".
+	const WindowsRoot windows_root = parse_windows_root(path);
+	const std::size_t root_size = windows_root.kind == WindowsRoot::Kind::drive ? 2 : 3 + windows_root.server.size() + windows_root.share.size();
+	return std::max(path.size(), root_size + 1);
+}
+
+boost::optional<std::size_t> normalize_path_in_place(char *path, std::size_t size, std::size_t capacity, const ProjectRoot &root) {
+	const boost::string_view input{ path, size };
+	if (capacity < normalize_path_in_place_capacity(input, root)) return boost::none;
+
+	const bool is_canonical = root.is_windows() ? is_canonical_input<WindowsFlavor>(input) : is_canonical_input<PosixFlavor>(input);
+	if (is_canonical) return size;
+
+	const std::size_t offset = in_place_offset(input, root);
+	std::copy_backward(path, path + size, path + offset + size);
+
+	InPlaceOutput output{ path, 0, 0 };
+	const boost::string_view moved_path{ path + offset, size };
+	const bool is_valid = root.is_windows() ?
+		normalize_subpaths<WindowsFlavor>(moved_path, root, output) :
+		normalize_subpaths<PosixFlavor>(moved_path, root, output);
+
+	if (!is_valid) return boost::none;
+	return output.size;
+}
+
+boost::optional<boost::string_view> normalize_path_view(boost::string_view path, const ProjectRoot &root, std::string &buffer) {
+	const bool is_canonical = root.is_windows() ? is_canonical_input<WindowsFlavor>(path) : is_canonical_input<PosixFlavor>(path);
+	if (is_canonical) return path;
+
+	NormalizedStringOutput<std::string> output{ buffer, 0 };
+	const bool is_valid = root.is_windows() ?
+		normalize_subpaths<WindowsFlavor>(path, root, output) :
+		normalize_subpaths<PosixFlavor>(path, root, output);
+
+	if (!is_valid) return boost::none;
+	return boost::string_view{ buffer };
+}
+
+bool normalize_path_in_place(std::string &path, const ProjectRoot &root) {
+	const std::size_t size = path.size();
+	path.resize(normalize_path_in_place_capacity(path, root));
+
+	const boost::optional<std::size_t> normalized_size = normalize_path_in_place(&path[0], size, path.size(), root);
+	if (!normalized_size) return false;
+
+	path.resize(*normalized_size);
+	return true;
+}
+
+// Hashes the normalized path as NormalizedStringOutput would write it. hashes holds the
+// hash after every pushed subpath, so a ".." only drops the last one, and the hashes
+// of the root directory are precomputed by ProjectRoot.
+struct NormalizedHashOutput {
+	const ProjectRoot *root;
+	std::size_t root_depth;
+	boost::container::small_vector<std::uint64_t, 16> hashes;
+
+	void assign_root(const ProjectRoot &root, boost::string_view drive, std::size_t root_depth, RebasablePath::Anchor) {
+		this->root = &root;
+		this->root_depth = root_depth;
+		hashes.clear();
+		hashes.push_back(root_depth > 0 ? root.hash(root_depth) : hash_append(hash_append(fnv_offset_basis, drive), '/'));
+	}
+
+	void push_subpath(boost::string_view subpath) {
+		std::uint64_t hash = hashes.back();
+		if (hashes.size() > 1 || root_depth > 0) hash = hash_append(hash, '/');
+		hashes.push_back(hash_append(hash, subpath));
+	}
+
+	bool pop_subpath() {
+		if (hashes.size() > 1) {
+			hashes.pop_back();
+			return true;
+		}
+
+		if (root_depth == 0) return false;
+		hashes[0] = root->hash(--root_depth);
+		return true;
+	}
+};
+
+boost::optional<std::uint64_t> normalized_hash(boost::string_view path, const ProjectRoot &root) {
+	const bool is_canonical = root.is_windows() ? is_canonical_input<WindowsFlavor>(path) : is_canonical_input<PosixFlavor>(path);
+	if (is_canonical) return normalized_path_hash(path);
+
+	thread_local NormalizedHashOutput output;
+	const bool is_valid = root.is_windows() ?
+		normalize_subpaths<WindowsFlavor>(path, root, output) :
+		normalize_subpaths<PosixFlavor>(path, root, output);
+
+	if (!is_valid) return boost::none;
+	return output.hashes.back();
+}
+
+// The normalized path as its drive and subpaths, viewing into the input and the root.
+// The drive is copied, as it may be one normalize_subpaths wrote.
+struct SubpathViewsOutput {
+	std::string drive;
+	boost::container::small_vector<boost::string_view, 16> subpaths;
+
+	void assign_root(const ProjectRoot &root, boost::string_view drive, std::size_t root_depth, RebasablePath::Anchor) {
+		this->drive.assign(drive.data(), drive.size());
+		subpaths.clear();
+		for (std::size_t index = 0; index < root_depth; ++index) subpaths.push_back(root.subpath(index));
+	}
+
+	void push_subpath(boost::string_view subpath) {
+		subpaths.push_back(subpath);
+	}
+
+	bool pop_subpath() {
+		if (subpaths.empty()) return false;
+		subpaths.pop_back();
+		return true;
+	}
+};
+
+template <typename Flavor>
+bool same_normalized(boost::string_view lhs, boost::string_view rhs, const ProjectRoot &root) {
+	if (count_canonical_subpaths<Flavor>(lhs) != 0 && count_canonical_subpaths<Flavor>(rhs) != 0) return lhs == rhs;
+
+	thread_local SubpathViewsOutput lhs_output;
+	thread_local SubpathViewsOutput rhs_output;
+	if (!normalize_subpaths<Flavor>(lhs, root, lhs_output) || !normalize_subpaths<Flavor>(rhs, root, rhs_output)) return false;
+
+	return lhs_output.drive == rhs_output.drive &&
+		std::equal(lhs_output.subpaths.begin(), lhs_output.subpaths.end(), rhs_output.subpaths.begin(), rhs_output.subpaths.end());
+}
+
+bool same_normalized(boost::string_view lhs, boost::string_view rhs, const ProjectRoot &root) {
+	return root.is_windows() ? same_normalized<WindowsFlavor>(lhs, rhs, root) : same_normalized<PosixFlavor>(lhs, rhs, root);
+}
+
+// Records the anchor of the normalized path and writes the rest of it into the tail.
+struct RebasablePathOutput {
+	RebasablePath &rebasable_path;
+	std::size_t root_size;
+	std::size_t root_depth;
+
+	void assign_root(const ProjectRoot &root, boost::string_view drive, std::size_t root_depth, RebasablePath::Anchor anchor) {
+		rebasable_path.anchor = anchor;
+		rebasable_path.is_windows = root.is_windows();
+		rebasable_path.pop_count = anchor == RebasablePath::Anchor::project ? root.depth() - root_depth : 0;
+		rebasable_path.tail.clear();
+		this->root_depth = root_depth;
+
+		if (anchor == RebasablePath::Anchor::absolute) {
+			rebasable_path.tail.assign(drive.data(), drive.size());
+			rebasable_path.tail.push_back('/');
+		}
+		root_size = rebasable_path.tail.size();
+	}
+
+	void push_subpath(boost::string_view subpath) {
+		std::string &tail = rebasable_path.tail;
+		if (tail.size() > root_size) tail.push_back('/');
+		tail.append(subpath.data(), subpath.size());
+	}
+
+	bool pop_subpath() {
+		std::string &tail = rebasable_path.tail;
+		if (tail.size() == root_size) {
+			// Back in the project directory, which root_depth is only non-zero for.
+			if (root_depth == 0) return false;
+			--root_depth;
+			++rebasable_path.pop_count;
+			return true;
+		}
+
+		const std::size_t separator = tail.rfind('/');
+		tail.resize(separator == std::string::npos || separator < root_size ? root_size : separator);
+		return true;
+	}
+};
+
+bool normalize_path(boost::string_view path, const ProjectRoot &root, RebasablePath &rebasable_path) {
+	RebasablePathOutput output{ rebasable_path, 0, 0 };
+	if (!root.is_windows()) {
+		rebasable_path.drive_letter = '\0';
+		return normalize_subpaths<PosixFlavor>(path, root, output);
+	}
+
+	// normalize_subpaths only accepted "C:foo" because the project directory is on drive C.
+	const WindowsRoot windows_root = parse_windows_root(path);
+	rebasable_path.drive_letter = windows_root.kind == WindowsRoot::Kind::drive_relative ? windows_root.drive_letter : '\0';
+	return normalize_subpaths<WindowsFlavor>(path, root, output);
+}
+
+bool rebase_path(const RebasablePath &rebasable_path, const ProjectRoot &root, std::string &normalized_path) {
+	if (rebasable_path.is_windows != root.is_windows()) return false;
+	if (rebasable_path.drive_letter != '\0') {
+		const boost::string_view drive = root.drive();
+		if (drive.size() != 2 || drive[0] != rebasable_path.drive_letter) return false;
+	}
+
+	boost::string_view prefix;
+	switch (rebasable_path.anchor) {
+	case RebasablePath::Anchor::project:
+		if (rebasable_path.pop_count > root.depth()) return false;
+		prefix = root.path(root.depth() - rebasable_path.pop_count);
+		break;
+	case RebasablePath::Anchor::drive:
+		prefix = root.path(0);
+		break;
+	case RebasablePath::Anchor::absolute:
+		break;
+	}
+
+	// Only "/", "Z:/" and "//server/share/" end in a separator.
+	const bool needs_separator = !rebasable_path.tail.empty() && !prefix.empty() && prefix.back() != '/';
+	normalized_path.assign(prefix.data(), prefix.size());
+	if (needs_separator) normalized_path.push_back('/');
+	normalized_path.append(rebasable_path.tail);
+	return true;
+}
+
+// Interns the normalized subpaths. A ".." drops the last id.
+struct CompactPathOutput {
+	SubpathInterner &interner;
+	CompactPath &compact_path;
+
+	void assign_root(const ProjectRoot &root, boost::string_view drive, std::size_t root_depth, RebasablePath::Anchor) {
+		compact_path.clear();
+		compact_path.push_back(interner.intern(drive.empty() ? boost::string_view{ "/" } : drive));
+
+		for (std::size_t index = 0; index < root_depth; ++index) {
+			compact_path.push_back(interner.intern(root.subpath(index)));
+		}
+	}
+
+	void push_subpath(boost::string_view subpath) {
+		compact_path.push_back(interner.intern(subpath));
+	}
+
+	bool pop_subpath() {
+		if (compact_path.size() == 1) return false;
+		compact_path.pop_back();
+		return true;
+	}
+};
+
+bool normalize_path(boost::string_view path, const ProjectRoot &root, SubpathInterner &interner, CompactPath &compact_path) {
+	CompactPathOutput output{ interner, compact_path };
+	return root.is_windows() ?
+		normalize_subpaths<WindowsFlavor>(path, root, output) :
+		normalize_subpaths<PosixFlavor>(path, root, output);
+}
+
+std::string expand_path(const CompactPath &compact_path, const SubpathInterner &interner) {
+	assert(!compact_path.empty());
+	const boost::string_view root = interner.subpath(compact_path[0]);
+
+	std::string normalized_path{ root == "/" ? boost::string_view{} : root };
+	normalized_path.push_back('/');
+
+	for (auto iter = compact_path.begin() + 1; iter != compact_path.end(); ++iter) {
+		if (iter != compact_path.begin() + 1) normalized_path.push_back('/');
+		const boost::string_view subpath = interner.subpath(*iter);
+		normalized_path.append(subpath.data(), subpath.size());
+	}
+
+	return normalized_path;
+}
+
+std::uint32_t SubpathInterner::intern(boost::string_view subpath) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+
+	auto iter = m_ids.find(subpath);
+	if (iter != m_ids.end()) return iter->second;
+
+	assert(m_subpaths.size() < std::numeric_limits<std::uint32_t>::max());
+	const std::uint32_t id = static_cast<std::uint32_t>(m_subpaths.size());
+	m_subpaths.emplace_back(subpath.data(), subpath.size());
+	m_ids.emplace(boost::string_view{ m_subpaths.back() }, id);
+	return id;
+}
+
+boost::optional<std::uint32_t> SubpathInterner::find(boost::string_view subpath) const {
+	boost::optional<std::uint32_t> ret_opt;
+	std::lock_guard<std::mutex> lock{ m_mutex };
+
+	auto iter = m_ids.find(subpath);
+	if (iter != m_ids.end()) ret_opt = iter->second;
+
 	return ret_opt;
 }
 
-std::vector<std::string> convert_to_internal_path(std::string &normalized_path, bool is_windows) {
-	assert(is_normalized_path(normalized_path, is_windows));
-	return split_path(normalized_path);
+boost::string_view SubpathInterner::subpath(std::uint32_t id) const {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_subpaths[id];
 }
 
-/////////////////////////////////////////////////////////////////
+std::size_t SubpathInterner::size() const {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_subpaths.size();
+}
+
+const std::uint32_t PathTrie::no_node;
+
+PathTrie::PathTrie()
+	: m_size{ 0 },
+	m_nodes{ Node{ no_node, no_node, 1, 0, 0, false } } {
+}
+
+void PathTrie::insert(const std::vector<CompactPath> &compact_paths) {
+	std::vector<CompactPath> sorted_paths;
+	sorted_paths.reserve(m_size + compact_paths.size());
+	for_each_under(CompactPath{}, [&sorted_paths](const CompactPath &compact_path) {
+		sorted_paths.push_back(compact_path);
+	});
+	sorted_paths.insert(sorted_paths.end(), compact_paths.begin(), compact_paths.end());
+
+	std::sort(sorted_paths.begin(), sorted_paths.end());
+	sorted_paths.erase(std::unique(sorted_paths.begin(), sorted_paths.end()), sorted_paths.end());
+	assert(std::none_of(sorted_paths.begin(), sorted_paths.end(), [](const CompactPath &compact_path) { return compact_path.empty(); }));
+
+	// Sorted paths come out in depth-first order: every path only shares a prefix with
+	// the one before it, so the nodes past that prefix are closed and new ones opened.
+	m_size = sorted_paths.size();
+	m_nodes.assign(1, Node{ no_node, no_node, 0, 0, 0, false });
+	std::vector<std::uint32_t> open_nodes{ 0 };
+	const CompactPath *prev_path = nullptr;
+
+	for (const CompactPath &compact_path : sorted_paths) {
+		std::size_t common = 0;
+		if (prev_path != nullptr) {
+			common = std::mismatch(prev_path->begin(), prev_path->end(), compact_path.begin(), compact_path.end()).first - prev_path->begin();
+		}
+
+		for (; open_nodes.size() > common + 1; open_nodes.pop_back()) {
+			m_nodes[open_nodes.back()].subtree_end = static_cast<std::uint32_t>(m_nodes.size());
+		}
+
+		for (std::size_t depth = common; depth < compact_path.size(); ++depth) {
+			assert(m_nodes.size() < no_node);
+			open_nodes.push_back(static_cast<std::uint32_t>(m_nodes.size()));
+			m_nodes.push_back(Node{ compact_path[depth], open_nodes[open_nodes.size() - 2], 0, 0, 0, false });
+		}
 
-void print_vec(const std::string &ori, std::vector<std::string> &vec) {
-#if PRINT_ON == 1
-	std::cout << ori << " : { ";
-	for (const std::string str : vec) {
-		std::cout << "'" << str << "' ";
+		m_nodes[open_nodes.back()].is_path = true;
+		prev_path = &compact_path;
+	}
+
+	for (; !open_nodes.empty(); open_nodes.pop_back()) {
+		m_nodes[open_nodes.back()].subtree_end = static_cast<std::uint32_t>(m_nodes.size());
+	}
+
+	// Children appear in id order in the depth-first order too, so counting them per
+	// parent and laying the counts out back to back gives every parent its run.
+	for (std::size_t node = 1; node < m_nodes.size(); ++node) {
+		++m_nodes[m_nodes[node].parent].children_end;
+	}
+
+	std::uint32_t children_begin = 0;
+	for (Node &node : m_nodes) {
+		node.children_begin = children_begin;
+		children_begin += node.children_end;
+		node.children_end = node.children_begin;
+	}
+
+	m_child_ids.resize(m_nodes.size() - 1);
+	m_child_nodes.resize(m_nodes.size() - 1);
+	for (std::size_t node = 1; node < m_nodes.size(); ++node) {
+		Node &parent = m_nodes[m_nodes[node].parent];
+		m_child_ids[parent.children_end] = m_nodes[node].id;
+		m_child_nodes[parent.children_end] = static_cast<std::uint32_t>(node);
+		++parent.children_end;
 	}
-	std::cout << "}" << std::endl;
-#endif
 }
 
-void test_split_path() {
-#if PRINT_TEST_ON == 1
-	print_vec("", split_path(""));
-	print_vec("/", split_path("/"));
-	print_vec("//", split_path("//"));
-	print_vec("///", split_path("///"));
-
-	print_vec("a", split_path("a"));
-	print_vec("/a", split_path("/a"));
-	print_vec("a/b", split_path("a/b"));
-	print_vec("a/b/c", split_path("a/b/c"));
-	print_vec("/a/b", split_path("/a/b"));
-	print_vec("/a/b/c", split_path("/a/b/c"));
-
-	print_vec(".", split_path("."));
-	print_vec("/.", split_path("/."));
-	print_vec("/./..", split_path("/./.."));
-	print_vec("/./../..", split_path("/./../.."));
-
-	print_vec("a/", split_path("a/"));
-	print_vec("/a/", split_path("/a/"));
-	print_vec("a/b/", split_path("a/b/"));
-	print_vec("a/b/c", split_path("a/b/c/"));
-	print_vec("/a/b/", split_path("/a/b/"));
-	print_vec("/a/b/c", split_path("/a/b/c/"));
-
-	print_vec("./", split_path("./"));
-	print_vec("/./", split_path("/./"));
-	print_vec("/./../", split_path("/./../"));
-	print_vec("/./../../", split_path("/./../../"));
-
-	print_vec("C:", split_path("C:"));
-	print_vec("C:/", split_path("C:/"));
-	print_vec("C:/a", split_path("C:/a"));
-	print_vec("C:/a/b", split_path("C:/a/b"));
-	print_vec("C:/a/b/c", split_path("C:/a/b/c"));
-
-	print_vec("C:/.", split_path("C:/."));
-	print_vec("C:/./..", split_path("C:/./.."));
-	print_vec("C:/./../..", split_path("C:/./../.."));
-
-	print_vec("C:/a/", split_path("C:/a/"));
-	print_vec("C:/a/b/", split_path("C:/a/b/"));
-	print_vec("C:/a/b/c", split_path("C:/a/b/c/"));
-
-	print_vec("C:/./", split_path("C:/./"));
-	print_vec("C:/./../", split_path("C:/./../"));
-	print_vec("C:/./../../", split_path("C:/./../../"));
-
-	print_vec("a//", split_path("a//"));
-	print_vec("//a//", split_path("//a//"));
-	print_vec("a//b//", split_path("a//b//"));
-	print_vec("a//b//c", split_path("a//b//c//"));
-	print_vec("//a//b//", split_path("//a//b//"));
-	print_vec("//a//b//c", split_path("//a/b//c//"));
+std::uint32_t PathTrie::find_child(std::uint32_t node, std::uint32_t id) const {
+	const auto first = m_child_ids.begin() + m_nodes[node].children_begin;
+	const auto last = m_child_ids.begin() + m_nodes[node].children_end;
+	const auto iter = std::lower_bound(first, last, id);
 
-#endif
-	assert(split_path("") == split_path(""));
-	assert(split_path("/") == split_path("\\"));
-	assert(split_path("a") == split_path("a"));
-	assert(split_path("/a") == split_path("\\a"));
-	assert(split_path("a/b") == split_path("a\\b"));
-	assert(split_path("a/b/c") == split_path("a\\b\\c"));
-	assert(split_path("/a/b") == split_path("\\a\\b"));
-	assert(split_path("/a/b/c") == split_path("\\a\\b\\c"));
-
-	assert(split_path(".") == split_path("."));
-	assert(split_path("/.") == split_path("\\."));
-	assert(split_path("/./..") == split_path("\\.\\.."));
-	assert(split_path("/./../..") == split_path("\\.\\..\\.."));
-
-	assert(split_path("/a//") == split_path("\\a/"));
-	assert(split_path("a/b/") == split_path("a\\b\\"));
-	assert(split_path("a/b/c/") == split_path("a\\b\\c\\"));
-	assert(split_path("/a/b/") == split_path("\\a\\b\\"));
-	assert(split_path("/a/b/c/") == split_path("\\a\\b\\c\\"));
-
-	assert(split_path("./") == split_path(".\\"));
-	assert(split_path("/./") == split_path("\\.\\"));
-	assert(split_path("/./../") == split_path("\\.\\..\\"));
-	assert(split_path("/./../../") == split_path("\\.\\..\\..\\"));
-	
-}
-
-void test_is_valid_path() {
-	assert(!is_valid_path("", false));
-	assert(!is_valid_path("\\", false));
-	assert(!is_valid_path("C:", false));
-	assert(!is_valid_path("C:/", false));
-	assert(!is_valid_path("C:/a", false));
-
-	assert(is_valid_path("a//b//c//", false));
-	assert(is_valid_path("//a//b//c", false));
-
-	assert(is_valid_path("/", false));
-	assert(is_valid_path("//", false));
-	assert(is_valid_path("///", false));
-	assert(is_valid_path("a", false));
-	assert(is_valid_path("/a", false));
-	assert(is_valid_path("a/b", false));
-	assert(is_valid_path("a/b/c", false));
-	assert(is_valid_path("/a/b", false));
-	assert(is_valid_path("/a/b/c", false));
-
-	assert(is_valid_path(".", false));
-	assert(is_valid_path("/.", false));
-	assert(is_valid_path("/./..", false));
-	assert(is_valid_path("/./../..", false));
-	assert(is_valid_path("a/", false));
-	assert(is_valid_path("/a/", false));
-	assert(is_valid_path("a/b/", false));
-	assert(is_valid_path("a/b/c", false));
-	assert(is_valid_path("/a/b/", false));
-	assert(is_valid_path("/a/b/c", false));
-	assert(is_valid_path("./", false));
-	assert(is_valid_path("/./", false));
-	assert(is_valid_path("/./../", false));
-	assert(is_valid_path("/./../../", false));
-
-	assert(is_valid_path("/", true));
-	assert(is_valid_path("//", true));
-	assert(is_valid_path("///", true));
-	assert(is_valid_path("a", true));
-	assert(is_valid_path("/a", true));
-	assert(is_valid_path("a/b", true));
-	assert(is_valid_path("a/b/c", true));
-	assert(is_valid_path("/a/b", true));
-	assert(is_valid_path("/a/b/c", true));
-
-	assert(is_valid_path(".", true));
-	assert(is_valid_path("/.", true));
-	assert(is_valid_path("/./..", true));
-	assert(is_valid_path("/./../..", true));
-	assert(is_valid_path("a/", true));
-	assert(is_valid_path("/a/", true));
-	assert(is_valid_path("a/b/", true));
-	assert(is_valid_path("a/b/c", true));
-	assert(is_valid_path("/a/b/", true));
-	assert(is_valid_path("/a/b/c", true));
-	assert(is_valid_path("./", true));
-	assert(is_valid_path("/./", true));
-	assert(is_valid_path("/./../", true));
-	assert(is_valid_path("/./../../", true));
-
-	assert(is_valid_path("C:", true));
-	assert(is_valid_path("C:/", true));
-	assert(is_valid_path("C:/a", true));
-	assert(is_valid_path("C:/a/b", true));
-	assert(is_valid_path("C:/a/b/c", true));
-	assert(is_valid_path("C:/.", true));
-	assert(is_valid_path("C:/./..", true));
-	assert(is_valid_path("C:/a/", true));
-	assert(is_valid_path("//a/b//c//", true));
-	assert(is_valid_path("a//b//", true));
-
-	assert(is_valid_path("C:\\", true));
-	assert(is_valid_path("C:\\a", true));
-	assert(is_valid_path("C:\\a\\b", true));
-	assert(is_valid_path("C:\\a\\b\\c", true));
-	assert(is_valid_path("C:\\.", true));
-	assert(is_valid_path("C:\\.\\..", true));
-	assert(is_valid_path("C:\\a\\", true));
-	assert(is_valid_path("\\\\a/b\\\\c\\\\", true));
-	assert(is_valid_path("a\\\\b\\\\", true));
-
-	assert(!is_valid_path("c:\\", true));
-}
-
-void test_is_normalized_path() {
-	assert(!is_normalized_path("a//b//c//", false));
-	assert(is_normalized_path("//a//b//c", false));
-
-	assert(is_normalized_path("/", false));
-	assert(is_normalized_path("//", false));
-	assert(is_normalized_path("///", false));
-	assert(!is_normalized_path("a", false));
-	assert(is_normalized_path("/a", false));
-	assert(!is_normalized_path("a/b", false));
-	assert(!is_normalized_path("a/b/c", false));
-	assert(is_normalized_path("/a/b", false));
-	assert(is_normalized_path("/a/b/c", false));
-
-	assert(!is_normalized_path(".", false));
-	assert(!is_normalized_path("/.", false));
-	assert(!is_normalized_path("/./..", false));
-	assert(!is_normalized_path("/./../..", false));
-	assert(!is_normalized_path("a/", false));
-	assert(is_normalized_path("/a/", false));
-	assert(!is_normalized_path("a/b/", false));
-	assert(!is_normalized_path("a/b/c", false));
-	assert(is_normalized_path("/a/b/", false));
-	assert(is_normalized_path("/a/b/c", false));
-	assert(!is_normalized_path("./", false));
-	assert(!is_normalized_path("/./", false));
-	assert(!is_normalized_path("/./../", false));
-	assert(!is_normalized_path("/./../../", false));
-
-	assert(!is_normalized_path("/", true));
-	assert(!is_normalized_path("//", true));
-	assert(!is_normalized_path("///", true));
-	assert(!is_normalized_path("a", true));
-	assert(!is_normalized_path("/a", true));
-	assert(!is_normalized_path("a/b", true));
-	assert(!is_normalized_path("a/b/c", true));
-	assert(!is_normalized_path("/a/b", true));
-	assert(!is_normalized_path("/a/b/c", true));
-
-	assert(!is_normalized_path(".", true));
-	assert(!is_normalized_path("/.", true));
-	assert(!is_normalized_path("/./..", true));
-	assert(!is_normalized_path("/./../..", true));
-	assert(!is_normalized_path("a/", true));
-	assert(!is_normalized_path("/a/", true));
-	assert(!is_normalized_path("a/b/", true));
-	assert(!is_normalized_path("a/b/c", true));
-	assert(!is_normalized_path("/a/b/", true));
-	assert(!is_normalized_path("/a/b/c", true));
-	assert(!is_normalized_path("./", true));
-	assert(!is_normalized_path("/./", true));
-	assert(!is_normalized_path("/./../", true));
-	assert(!is_normalized_path("/./../../", true));
-
-	assert(is_normalized_path("C:", true));
-	assert(is_normalized_path("C:/", true));
-	assert(is_normalized_path("C:/a", true));
-	assert(is_normalized_path("C:/a/b", true));
-	assert(is_normalized_path("C:/a/b/c", true));
-	assert(!is_normalized_path("C:/.", true));
-	assert(!is_normalized_path("C:/./..", true));
-	assert(is_normalized_path("C:/a/", true));
-	assert(!is_normalized_path("//a/b//c//", true));
-	assert(!is_normalized_path("a//b//", true));
-
-	assert(is_normalized_path("C:\\", true));
-	assert(is_normalized_path("C:\\a", true));
-	assert(is_normalized_path("C:\\a\\b", true));
-	assert(is_normalized_path("C:\\a\\b\\c", true));
-	assert(!is_normalized_path("C:\\.", true));
-	assert(!is_normalized_path("C:\\.\\..", true));
-	assert(is_normalized_path("C:\\a\\", true));
-	assert(!is_normalized_path("\\\\a/b\\\\c\\\\", true));
-	assert(!is_normalized_path("a\\\\b\\\\", true));
-}
-
-void test_normalize_path(const std::vector<std::string> &src_prj_dir, const std::string &src_prj_path, const std::string &one_less) {
-	boost::optional<std::string> normalized_path;
-	const bool is_win = has_windows_drive(src_prj_dir[0]);
-	std::string drive{ "" };
-	if (is_win) {
-		drive = src_prj_dir[0];
-	}
-
-	auto add_win = [&drive](const char *res) {
-		return drive + res;
+	return iter != last && *iter == id ? m_child_nodes[iter - m_child_ids.begin()] : no_node;
+}
+
+std::uint32_t PathTrie::find_node(const CompactPath &compact_path, bool longest_path) const {
+	std::uint32_t node = 0;
+	std::uint32_t longest_node = no_node;
+
+	for (std::uint32_t id : compact_path) {
+		node = find_child(node, id);
+		if (node == no_node) break;
+		if (m_nodes[node].is_path) longest_node = node;
+	}
+
+	return longest_path ? longest_node : node;
+}
+
+bool PathTrie::contains(const CompactPath &compact_path) const {
+	const std::uint32_t node = find_node(compact_path, false);
+	return node != no_node && !compact_path.empty() && m_nodes[node].is_path;
+}
+
+boost::optional<std::size_t> PathTrie::longest_prefix(const CompactPath &compact_path) const {
+	boost::optional<std::size_t> ret_opt;
+	std::uint32_t node = find_node(compact_path, true);
+
+	if (node != no_node) {
+		std::size_t depth = 0;
+		for (; node != 0; node = m_nodes[node].parent) ++depth;
+		ret_opt = depth;
+	}
+
+	return ret_opt;
+}
+
+boost::optional<boost::string_view> NormalizedPaths::operator[](std::size_t index) const {
+	boost::optional<boost::string_view> ret_opt;
+	const Entry &entry = m_entries[index];
+
+	if (entry.is_valid) {
+		ret_opt = boost::string_view{ m_arenas[index / chunk_size] }.substr(entry.offset, entry.size);
+	}
+
+	return ret_opt;
+}
+
+void normalize_paths(const std::vector<boost::string_view> &paths, const ProjectRoot &root,
+	NormalizedPaths &normalized_paths, std::size_t thread_count) {
+	const std::size_t chunk_size = NormalizedPaths::chunk_size;
+	const std::size_t chunk_count = (paths.size() + chunk_size - 1) / chunk_size;
+
+	normalized_paths.m_entries.resize(paths.size());
+	normalized_paths.m_arenas.resize(std::max(normalized_paths.m_arenas.size(), chunk_count));
+
+	std::atomic<std::size_t> next_chunk{ 0 };
+	// The first exception thrown on any thread, rethrown once every thread is joined.
+	std::mutex error_mutex;
+	std::exception_ptr error;
+
+	auto worker = [&]() {
+		try {
+			std::string normalized_path;
+
+			for (std::size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+				std::string &arena = normalized_paths.m_arenas[chunk];
+				arena.clear();
+
+				const std::size_t end = std::min(paths.size(), (chunk + 1) * chunk_size);
+				for (std::size_t index = chunk * chunk_size; index < end; ++index) {
+					NormalizedPaths::Entry &entry = normalized_paths.m_entries[index];
+					entry.is_valid = normalize_path(paths[index], root, normalized_path);
+					entry.offset = arena.size();
+					entry.size = entry.is_valid ? normalized_path.size() : 0;
+					if (entry.is_valid) arena.append(normalized_path);
+				}
+			}
+		}
+		catch (...) {
+			// Claim every chunk left, so the other workers stop after their current one.
+			next_chunk = chunk_count;
+			std::lock_guard<std::mutex> lock{ error_mutex };
+			if (!error) error = std::current_exception();
+		}
 	};
 
-	normalized_path = normalize_path("", src_prj_dir);
-	assert(normalized_path == boost::none);
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	thread_count = std::min(thread_count, chunk_count);
+
+	// Workers take chunks until there are none left, so when a thread cannot be started
+	// the ones that were, and this one, take its chunks. Every started thread is joined
+	// before the error is rethrown, since a joinable std::thread terminates on destruction.
+	std::vector<std::thread> threads;
+	try {
+		threads.reserve(thread_count);
+		for (std::size_t i = 1; i < thread_count; ++i) {
+			threads.emplace_back(worker);
+		}
+	}
+	catch (const std::system_error &) {
+	}
+	catch (const std::bad_alloc &) {
+	}
 
-	normalized_path = normalize_path("/", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/"));
+	worker();
 
-	normalized_path = normalize_path("a//b//c//", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path + "/a/b/c");
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
 
-	normalized_path = normalize_path("//a//b//c", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/a/b/c"));
+	if (error) std::rethrow_exception(error);
+}
 
-	normalized_path = normalize_path("//", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/"));
+std::size_t NormalizedPathCache::KeyHash::operator()(const KeyView &key) const {
+	std::size_t seed = boost::hash_range(key.path.begin(), key.path.end());
+	boost::hash_combine(seed, key.root_id);
+	return seed;
+}
 
-	normalized_path = normalize_path("///", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/"));
+NormalizedPathCache::NormalizedPathCache(std::size_t capacity, std::size_t shard_count) {
+	// Every shard holds at least one entry, so there are no more shards than entries.
+	shard_count = std::max<std::size_t>(1, std::min(shard_count, capacity));
+	m_shard_capacity = std::max<std::size_t>(1, capacity / shard_count);
+	for (std::size_t i = 0; i < shard_count; ++i) {
+		m_shards.emplace_back(new Shard);
+	}
+}
 
-	normalized_path = normalize_path("a", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path + "/a");
+boost::optional<std::string> NormalizedPathCache::normalize_path(const std::string &path, const ProjectRoot &root) {
+	boost::optional<std::string> ret_opt;
+	std::string normalized_path;
 
-	normalized_path = normalize_path("/a", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/a"));
+	if (normalize_path(boost::string_view{ path }, root, normalized_path)) {
+		ret_opt = std::move(normalized_path);
+	}
 
-	normalized_path = normalize_path("a/b", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path+ "/a/b");
+	return ret_opt;
+}
 
-	normalized_path = normalize_path("a/b/c", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path + "/a/b/c");
+bool NormalizedPathCache::normalize_path(boost::string_view path, const ProjectRoot &root, std::string &normalized_path) {
+	const KeyView key_view{ root.id(), path };
+	const std::size_t hash = KeyHash{}(key_view);
+	// The low bits pick the bucket inside the shard, so pick the shard with the high ones.
+	Shard &shard = *m_shards[(hash >> 16) % m_shards.size()];
+
+	{
+		std::lock_guard<std::mutex> lock{ shard.mutex };
+		auto iter = shard.index.find(key_view, KeyHash{}, KeyEqual{});
+
+		if (iter != shard.index.end()) {
+			Slot &slot = shard.slots[iter->second];
+			slot.is_referenced = true;
+			++shard.hits;
+			normalized_path.assign(slot.normalized_path);
+			return slot.is_valid;
+		}
 
-	normalized_path = normalize_path("/a/b", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/a/b"));
+		++shard.misses;
+	}
 
-	normalized_path = normalize_path(".", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path);
+	// Normalize outside the lock. Another thread may insert the same key meanwhile,
+	// in which case its entry is kept.
+	const bool is_valid = ::normalize_path(path, root, normalized_path);
 
-	normalized_path = normalize_path("..", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == one_less);
+	std::lock_guard<std::mutex> lock{ shard.mutex };
+	if (shard.index.find(key_view, KeyHash{}, KeyEqual{}) != shard.index.end()) return is_valid;
 
-	normalized_path = normalize_path("/.", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/"));
+	Slot slot{ Key{ root.id(), std::string{ path.data(), path.size() } },
+		is_valid ? normalized_path : std::string{}, is_valid, false };
 
-	normalized_path = normalize_path("/./..", src_prj_dir);
-	assert(normalized_path == boost::none);
+	std::size_t slot_index = shard.slots.size();
+	if (slot_index < m_shard_capacity) {
+		shard.slots.push_back(std::move(slot));
+	}
+	else {
+		// Give every referenced entry a second chance before evicting it.
+		while (shard.slots[shard.clock_hand].is_referenced) {
+			shard.slots[shard.clock_hand].is_referenced = false;
+			shard.clock_hand = (shard.clock_hand + 1) % shard.slots.size();
+		}
 
-	normalized_path = normalize_path("/./..", src_prj_dir);
-	assert(normalized_path == boost::none);
+		slot_index = shard.clock_hand;
+		shard.clock_hand = (shard.clock_hand + 1) % shard.slots.size();
+		shard.index.erase(shard.slots[slot_index].key);
+		shard.slots[slot_index] = std::move(slot);
+		++shard.evictions;
+	}
 
-	normalized_path = normalize_path("/./../..", src_prj_dir);
-	assert(normalized_path == boost::none);
+	shard.index.emplace(shard.slots[slot_index].key, slot_index);
+	return is_valid;
+}
 
-	normalized_path = normalize_path("a/", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path + "/a");
+NormalizedPathCache::Stats NormalizedPathCache::stats() const {
+	Stats stats{ 0, 0, 0 };
 
-	normalized_path = normalize_path("/a/", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/a"));
+	for (const std::unique_ptr<Shard> &shard : m_shards) {
+		std::lock_guard<std::mutex> lock{ shard->mutex };
+		stats.hits += shard->hits;
+		stats.misses += shard->misses;
+		stats.evictions += shard->evictions;
+	}
 
-	normalized_path = normalize_path("a/b/", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path + "/a/b");
+	return stats;
+}
 
-	normalized_path = normalize_path("/a/b/", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/a/b"));
+void NormalizedPathCache::clear() {
+	for (const std::unique_ptr<Shard> &shard : m_shards) {
+		std::lock_guard<std::mutex> lock{ shard->mutex };
+		shard->index.clear();
+		shard->slots.clear();
+		shard->clock_hand = 0;
+	}
+}
 
-	normalized_path = normalize_path("/a/b/c/", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/a/b/c"));
+#ifdef _WIN32
+typedef WindowsFlavor HostFlavor;
+#else
+typedef PosixFlavor HostFlavor;
+#endif
 
-	normalized_path = normalize_path("./", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path);
+// Builds the resolved path subpath by subpath, looking every new prefix up through the
+// cache of the resolver. A symlink is replaced by its target, whose subpaths are fed
+// back through push_subpath and pop_subpath as if they had been part of the path.
+template <typename Flavor>
+struct PhysicalOutput {
+	PhysicalPathResolver &resolver;
+	std::string &resolved_path;
+	std::size_t root_size;
+	// Where the first subpath that does not exist ends, npos while all of them exist.
+	// Nothing below it can exist, so it is not looked up.
+	std::size_t missing_end;
+	std::size_t link_count;
+	// Cleared by what normalize_subpaths does not see: invalid link targets, ".." in
+	// them going above the root and symlink loops.
+	bool is_valid;
+
+	void assign_root(const ProjectRoot &root, boost::string_view drive, std::size_t root_depth, RebasablePath::Anchor anchor) {
+		resolved_path.assign(drive.data(), drive.size());
+		resolved_path.push_back('/');
+		root_size = resolved_path.size();
+		if (anchor != RebasablePath::Anchor::project) return;
+
+		// The ".." in front of the first subpath went up from the project directory
+		// lexically, so redo them from where it physically is.
+		for (std::size_t i = 0; i < root.depth(); ++i) push_subpath(root.subpath(i));
+		for (std::size_t i = root_depth; i < root.depth(); ++i) {
+			if (!pop_subpath()) is_valid = false;
+		}
+	}
 
-	normalized_path = normalize_path("/./", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/"));
+	void push_subpath(boost::string_view subpath) {
+		if (!is_valid) return;
+
+		const std::size_t parent_size = resolved_path.size();
+		if (parent_size > root_size) resolved_path.push_back('/');
+		resolved_path.append(subpath.data(), subpath.size());
+		if (missing_end != std::string::npos) return;
+
+		std::string target;
+		switch (resolver.lookup(resolved_path, target)) {
+		case PhysicalPathResolver::EntryKind::missing:
+			missing_end = resolved_path.size();
+			return;
+		case PhysicalPathResolver::EntryKind::existing:
+			return;
+		case PhysicalPathResolver::EntryKind::symlink:
+			break;
+		}
 
-	normalized_path = normalize_path("/./../", src_prj_dir);
-	assert(normalized_path == boost::none);
+		resolved_path.resize(parent_size);
+		if (++link_count > PhysicalPathResolver::max_links) {
+			is_valid = false;
+			return;
+		}
 
-	normalized_path = normalize_path("/./../../", src_prj_dir);
-	assert(normalized_path == boost::none);
+		bool is_first = true;
+		const bool is_valid_target = for_each_checked_subpath<Flavor>(target, [&](boost::string_view target_subpath, bool is_valid_chars) {
+			if (is_first) {
+				is_first = false;
+
+				// An absolute target starts over from its root, or from the current drive
+				// for a Windows target starting with a separator.
+				if (Flavor::is_root(target_subpath, false)) {
+					if (Flavor::is_windows && target_subpath != "/") {
+						resolved_path.clear();
+						parse_windows_root(target_subpath).append_to(resolved_path);
+					}
+					else {
+						resolved_path.resize(root_size - 1);
+					}
+					resolved_path.push_back('/');
+					root_size = resolved_path.size();
+					return true;
+				}
+			}
 
-	normalized_path = normalize_path("//a/b//c//", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == add_win("/a/b/c"));
+			if (!is_valid_chars || !Flavor::is_valid_name(target_subpath)) return false;
 
-	normalized_path = normalize_path("a//b//", src_prj_dir);
-	assert(normalized_path != boost::none);
-	assert(*normalized_path == src_prj_path + "/a/b");
+			if (target_subpath == ".") return true;
+			if (target_subpath == "..") return pop_subpath();
+			push_subpath(target_subpath);
+			return is_valid;
+		});
 
-	if (is_win) {
-		normalized_path = normalize_path("C:", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/");
+		if (!is_valid_target) is_valid = false;
+	}
 
-		normalized_path = normalize_path("C:/", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/");
+	bool pop_subpath() {
+		if (resolved_path.size() == root_size) return false;
+		resolved_path.resize(std::max(resolved_path.rfind('/'), root_size));
+		if (resolved_path.size() < missing_end) missing_end = std::string::npos;
+		return true;
+	}
+};
 
-		normalized_path = normalize_path("C:/a", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a");
+const std::size_t PhysicalPathResolver::default_capacity;
 
-		normalized_path = normalize_path("C:/a/b", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a/b");
+PhysicalPathResolver::PhysicalPathResolver(std::chrono::steady_clock::duration ttl, std::size_t shard_count, std::size_t capacity)
+	: m_ttl{ ttl } {
+	// Every shard holds at least one entry, so there are no more shards than entries.
+	shard_count = std::max<std::size_t>(1, std::min(shard_count, capacity));
+	m_shard_capacity = std::max<std::size_t>(1, capacity / shard_count);
+	for (std::size_t i = 0; i < shard_count; ++i) {
+		m_shards.emplace_back(new Shard);
+	}
+}
 
-		normalized_path = normalize_path("C:/a/b/c", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a/b/c");
+boost::optional<std::string> PhysicalPathResolver::resolve_path(const std::string &path, const ProjectRoot &root) {
+	boost::optional<std::string> ret_opt;
+	std::string resolved_path;
 
-		normalized_path = normalize_path("C:/.", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/");
+	if (resolve_path(boost::string_view{ path }, root, resolved_path)) {
+		ret_opt = std::move(resolved_path);
+	}
 
-		normalized_path = normalize_path("C:/./..", src_prj_dir);
-		assert(normalized_path == boost::none);
+	return ret_opt;
+}
 
-		normalized_path = normalize_path("C:/a/", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a");
+bool PhysicalPathResolver::resolve_path(boost::string_view path, const ProjectRoot &root, std::string &resolved_path) {
+	if (root.is_windows() != HostFlavor::is_windows) return false;
 
-		normalized_path = normalize_path("C:/a/b/c", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a/b/c");
-		
-		normalized_path = normalize_path("C:\\", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/");
+	PhysicalOutput<HostFlavor> output{ *this, resolved_path, 0, std::string::npos, 0, true };
+	return normalize_subpaths<HostFlavor>(path, root, output) && output.is_valid;
+}
 
-		normalized_path = normalize_path("C:\\a", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a");
+PhysicalPathResolver::EntryKind PhysicalPathResolver::lookup(boost::string_view path, std::string &target) {
+	const std::size_t hash = PathHash{}(path);
+	// The low bits pick the bucket inside the shard, so pick the shard with the high ones.
+	Shard &shard = *m_shards[(hash >> 16) % m_shards.size()];
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	bool is_expired = false;
+
+	{
+		std::lock_guard<std::mutex> lock{ shard.mutex };
+		auto iter = shard.entries.find(path, PathHash{}, PathEqual{});
+
+		if (iter != shard.entries.end()) {
+			if (now < iter->second.expiry) {
+				++shard.hits;
+				target.assign(iter->second.target);
+				return iter->second.kind;
+			}
+			++shard.expirations;
+			is_expired = true;
+		}
 
-		normalized_path = normalize_path("C:\\a\\b", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a/b");
+		++shard.misses;
+	}
 
-		normalized_path = normalize_path("C:\\a\\b", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a/b");
+	// Look up outside the lock. Another thread may look up the same path meanwhile, in
+	// which case the entry stored last is kept.
+	const bool never_expires = m_ttl >= std::chrono::steady_clock::time_point::max() - now;
+	Entry entry{ EntryKind::missing, std::string{}, never_expires ? std::chrono::steady_clock::time_point::max() : now + m_ttl };
 
-		normalized_path = normalize_path("C:\\.", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/");
+	const boost::filesystem::path fs_path{ path.begin(), path.end() };
+	boost::system::error_code error;
+	const boost::filesystem::file_status status = boost::filesystem::symlink_status(fs_path, error);
+
+	if (status.type() == boost::filesystem::symlink_file) {
+		const boost::filesystem::path link_target = boost::filesystem::read_symlink(fs_path, error);
+		if (!error) {
+			entry.kind = EntryKind::symlink;
+			entry.target = link_target.string();
+		}
+	}
+	else if (!error && boost::filesystem::exists(status)) {
+		entry.kind = EntryKind::existing;
+	}
 
-		normalized_path = normalize_path("C:\\.\\..", src_prj_dir);
-		assert(normalized_path == boost::none);
+	target.assign(entry.target);
+	const EntryKind kind = entry.kind;
 
-		normalized_path = normalize_path("C:\\a\\", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == "C:/a");
+	std::lock_guard<std::mutex> lock{ shard.mutex };
+	auto iter = shard.entries.find(path, PathHash{}, PathEqual{});
 
-		normalized_path = normalize_path("\\\\a/b\\\\c\\\\", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == add_win("/a/b/c"));
+	// A path that went away is not kept around, or every path that ever existed would be.
+	if (is_expired && kind == EntryKind::missing) {
+		if (iter != shard.entries.end()) shard.entries.erase(iter);
+		return kind;
+	}
 
-		normalized_path = normalize_path("a\\\\b\\\\", src_prj_dir);
-		assert(normalized_path != boost::none);
-		assert(*normalized_path == src_prj_path + "/a/b");
+	if (iter != shard.entries.end()) {
+		iter->second = std::move(entry);
 	}
 	else {
-		normalized_path = normalize_path("\\", src_prj_dir);
-		assert(normalized_path == boost::none);
+		if (shard.entries.size() >= m_shard_capacity) evict(shard, now);
+		shard.entries.emplace(std::string{ path.data(), path.size() }, std::move(entry));
+	}
+	return kind;
+}
+
+void PhysicalPathResolver::evict(Shard &shard, std::chrono::steady_clock::time_point now) {
+	const std::size_t size = shard.entries.size();
+	for (auto iter = shard.entries.begin(); iter != shard.entries.end();) {
+		iter = now < iter->second.expiry ? std::next(iter) : shard.entries.erase(iter);
 	}
 
+	// Nothing has expired, so drop whichever entry comes first. It is looked up again
+	// from the file system if it is needed, as an expired one would be.
+	if (shard.entries.size() == size) shard.entries.erase(shard.entries.begin());
+	shard.evictions += size - shard.entries.size();
+}
+
+void PhysicalPathResolver::invalidate(boost::string_view resolved_path) {
+	// Only a root ends with '/', and everything lies below it.
+	const bool is_root_path = !resolved_path.empty() && resolved_path.back() == '/';
+
+	for (const std::unique_ptr<Shard> &shard : m_shards) {
+		std::lock_guard<std::mutex> lock{ shard->mutex };
+
+		for (auto iter = shard->entries.begin(); iter != shard->entries.end();) {
+			const boost::string_view path{ iter->first };
+			const bool is_below = path.starts_with(resolved_path) &&
+				(is_root_path || path.size() == resolved_path.size() || path[resolved_path.size()] == '/');
+			iter = is_below ? shard->entries.erase(iter) : std::next(iter);
+		}
+	}
 }
 
-int main() {
-	test_split_path();
-	test_is_valid_path();
-	test_is_normalized_path();
+std::size_t PhysicalPathResolver::prune_expired() {
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::size_t count = 0;
 
-	std::string src_prj_path{ "/data" };
-	std::vector<std::string> src_prj_dir = convert_to_internal_path(src_prj_path, false);
-	test_normalize_path(src_prj_dir, "/data", "/");
-	
-	src_prj_path = "Z:\\data";
-	src_prj_dir = convert_to_internal_path(src_prj_path, true);
-	test_normalize_path(src_prj_dir, "Z:/data", "Z:/");
+	for (const std::unique_ptr<Shard> &shard : m_shards) {
+		std::lock_guard<std::mutex> lock{ shard->mutex };
 
-	return 0;
+		for (auto iter = shard->entries.begin(); iter != shard->entries.end();) {
+			if (now < iter->second.expiry) {
+				++iter;
+			}
+			else {
+				iter = shard->entries.erase(iter);
+				++count;
+			}
+		}
+	}
+
+	return count;
+}
+
+PhysicalPathResolver::Stats PhysicalPathResolver::stats() const {
+	Stats stats{ 0, 0, 0, 0 };
+
+	for (const std::unique_ptr<Shard> &shard : m_shards) {
+		std::lock_guard<std::mutex> lock{ shard->mutex };
+		stats.hits += shard->hits;
+		stats.misses += shard->misses;
+		stats.expirations += shard->expirations;
+		stats.evictions += shard->evictions;
+	}
+
+	return stats;
+}
+
+void PhysicalPathResolver::clear() {
+	for (const std::unique_ptr<Shard> &shard : m_shards) {
+		std::lock_guard<std::mutex> lock{ shard->mutex };
+		shard->entries.clear();
+	}
+}
+
+std::vector<std::string> convert_to_internal_path(std::string &normalized_path, bool is_windows) {
+	assert(is_normalized_path(normalized_path, is_windows));
+	if (!is_windows) return split_path(normalized_path);
+
+	// split_path would take a share root apart.
+	std::vector<std::string> internal_path;
+	for_each_checked_subpath<WindowsFlavor>(normalized_path, [&internal_path](boost::string_view subpath, bool) {
+		internal_path.emplace_back(subpath.data(), subpath.size());
+		return true;
+	});
+	return internal_path;
 }
@@ -0,0 +1,965 @@
+#pragma once
+
+#include "stdafx.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define SIMD_ON 1
+#else
+#define SIMD_ON 0
+#endif
+
+inline BOOST_CONSTEXPR bool is_separator(char c);
+const char *find_separator_scalar(const char *first, const char *last);
+#if SIMD_ON == 1
+const char *find_separator_sse2(const char *first, const char *last);
+const char *find_separator_avx2(const char *first, const char *last);
+bool has_avx2();
+#endif
+// Calls the widest of the kernels above that the CPU supports.
+const char *find_separator(const char *first, const char *last);
+std::vector<std::string> split_path(const std::string &path);
+
+// Classes of every char value, so that tokenizing and validating a subpath costs one
+// table lookup per character.
+struct SubpathChars {
+	static const std::uint8_t slash = 0x01;
+	static const std::uint8_t backslash = 0x02;
+	// Not in the portable set of boost::filesystem::portable_posix_name.
+	static const std::uint8_t posix_invalid = 0x04;
+	// In the invalid set of boost::filesystem::windows_name.
+	static const std::uint8_t windows_invalid = 0x08;
+
+	static constexpr std::uint8_t of(char c) { return flags[static_cast<unsigned char>(c)]; }
+
+	static constexpr std::uint8_t flags[256] = {
+		0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C,
+		0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C,
+		0x04, 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x0D,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x0C, 0x04, 0x0C, 0x04,
+		0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x0E, 0x04, 0x04, 0x00,
+		0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x0C, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+		0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04
+	};
+};
+
+// Path flavors. The functions templated on a flavor are instantiated once per flavor,
+// so nothing in them branches on is_windows per subpath. The is_windows overloads
+// dispatch to them once per call.
+struct PosixFlavor {
+	static const bool is_windows = false;
+	// The SubpathChars classes that end a subpath and that a subpath cannot contain. A
+	// backslash is an invalid character rather than a separator, so it fails the path.
+	static const std::uint8_t separator_chars = SubpathChars::slash;
+	static const std::uint8_t invalid_chars = SubpathChars::posix_invalid;
+
+	static BOOST_CXX14_CONSTEXPR bool is_root(boost::string_view first_subpath, bool strict);
+	static BOOST_CXX14_CONSTEXPR bool is_valid_subpath(boost::string_view subpath);
+	// The checks of is_valid_subpath that are not about single characters.
+	static BOOST_CXX14_CONSTEXPR bool is_valid_name(boost::string_view subpath);
+};
+
+struct WindowsFlavor {
+	static const bool is_windows = true;
+	static const std::uint8_t separator_chars = SubpathChars::slash | SubpathChars::backslash;
+	static const std::uint8_t invalid_chars = SubpathChars::windows_invalid;
+
+	static BOOST_CXX14_CONSTEXPR bool is_root(boost::string_view first_subpath, bool strict);
+	static BOOST_CXX14_CONSTEXPR bool is_valid_subpath(boost::string_view subpath);
+	static BOOST_CXX14_CONSTEXPR bool is_valid_name(boost::string_view subpath);
+	// CON, PRN, AUX, NUL, COM1 to COM9 and LPT1 to LPT9 name devices, in any case and
+	// with any extension.
+	static BOOST_CXX14_CONSTEXPR bool is_reserved_name(boost::string_view subpath);
+};
+
+// The root a Windows path starts with. The forms recognized, and the roots normalize_path
+// resolves them to, with either separator anywhere in them:
+//   "C:\", "c:\", "C:"             "C:/"
+//   "\\server\share"               "//server/share/"
+//   "\\?\C:", "\\.\C:"             "C:/"
+//   "\\?\UNC\server\share"         "//server/share/"
+//   "\\?\device", "\\.\device"     "//?/device/", "//./device/"
+//   "\"                            the drive or share of the project directory
+//   "C:foo"                        the project directory, if it is on drive C
+// Before shares and devices were recognized, a path starting with two separators was on
+// the drive of the project directory like one starting with a single separator, so
+// "\\a\b\c" resolved to "Z:/a/b/c". It now resolves to "//a/b/c" on share b of server a,
+// and "\\a\\b" with a name missing fails. Paths meant for the drive of the project
+// directory should start with a single separator. Lowercase drives such as "c:\" used
+// to be invalid, and are now valid and normalized to "C:/".
+struct WindowsRoot {
+	enum class Kind : std::uint8_t {
+		// A relative path.
+		none,
+		// A separator not followed by a share or device.
+		separator,
+		drive,
+		// A drive not followed by a separator, relative to the current directory of the drive.
+		drive_relative,
+		// A UNC share, or a device with "?" or "." for its server.
+		share,
+		// Starts like a share or device, with a name missing or not valid.
+		invalid
+	};
+
+	Kind kind;
+	// In uppercase, for drive and drive_relative roots.
+	char drive_letter;
+	boost::string_view server;
+	boost::string_view share;
+	// The characters of the path the root spans, up to the separator after it. Only "C:"
+	// of "C:foo", and 1 for separator roots.
+	std::size_t size;
+
+	// Whether path starts with the root exactly as normalize_path writes it.
+	BOOST_CXX14_CONSTEXPR bool is_normalized(boost::string_view path) const;
+	// Appends the root as normalize_path writes it, without the separator after it, to
+	// a string-like path.
+	template <typename Path>
+	BOOST_CXX14_CONSTEXPR void append_to(Path &path) const;
+};
+
+inline BOOST_CXX14_CONSTEXPR WindowsRoot parse_windows_root(boost::string_view path);
+// A drive letter and ':', in either case.
+inline BOOST_CONSTEXPR bool has_windows_drive(boost::string_view first_subpath);
+// Whether path starts with a root only Windows paths have, a drive, share or device,
+// which picks the flavor of a project directory.
+inline BOOST_CXX14_CONSTEXPR bool has_windows_root(boost::string_view path);
+inline bool is_root(boost::string_view first_subpath, bool is_windows, bool strict);
+inline bool is_valid_subpath(boost::string_view subpath, bool is_windows);
+bool is_valid_path(const std::string &path, bool is_windows);
+bool is_normalized_path(const std::string &path, bool is_windows);
+template <typename Flavor> bool is_valid_path(boost::string_view path);
+template <typename Flavor> bool is_normalized_path(boost::string_view path);
+// Whether path is exactly what normalize_path writes, which is_normalized_path does not
+// require: a single '/' between subpaths and after the root, and none at the end.
+bool is_canonical_path(const std::string &path, bool is_windows);
+template <typename Flavor> bool is_canonical_path(boost::string_view path);
+
+boost::optional<std::string> normalize(const std::vector<std::string> &subpaths, bool is_windows);
+boost::optional<std::string> normalize_path(const std::string &path, const std::vector<std::string> &src_prj_dir);
+std::vector<std::string> convert_to_internal_path(std::string &normalized_path, bool is_windows);
+
+// Zero-copy variants: subpaths point into the caller's buffer, and the result is
+// written into a caller supplied string, so reusing it makes a call allocation free.
+// On failure the contents of normalized_path are unspecified.
+void split_path(boost::string_view path, std::vector<boost::string_view> &subpaths);
+bool normalize(const std::vector<boost::string_view> &subpaths, bool is_windows, std::string &normalized_path);
+bool normalize_path(boost::string_view path, const std::vector<std::string> &src_prj_dir, std::string &normalized_path);
+
+// A project directory, as returned by convert_to_internal_path, prepared once so that
+// many relative paths can be resolved against it without re-deriving anything.
+class ProjectRoot {
+public:
+	explicit ProjectRoot(const std::vector<std::string> &src_prj_dir);
+
+	bool is_windows() const { return m_is_windows; }
+	// "Z:" or "//server/share" for Windows roots, empty for POSIX roots.
+	boost::string_view drive() const { return boost::string_view{ m_path }.substr(0, m_ends[0] - 1); }
+	// Number of subpaths below the root.
+	std::size_t depth() const { return m_ends.size() - 1; }
+	// The normalized directory with only its first depth subpaths, "/", "Z:/" or
+	// "//server/share/" for 0.
+	boost::string_view path(std::size_t depth) const { return boost::string_view{ m_path }.substr(0, m_ends[depth]); }
+	boost::string_view path() const { return m_path; }
+	// The index-th subpath below the root.
+	boost::string_view subpath(std::size_t index) const {
+		const std::size_t first = m_ends[index] + (index > 0 ? 1 : 0);
+		return boost::string_view{ m_path }.substr(first, m_ends[index + 1] - first);
+	}
+	// normalized_path_hash of path(depth).
+	std::uint64_t hash(std::size_t depth) const { return m_hashes[depth]; }
+	// Unique to every constructed root and shared by its copies, for keying caches.
+	std::uint64_t id() const { return m_id; }
+
+private:
+	std::uint64_t m_id;
+	bool m_is_windows;
+	std::string m_path;
+	// m_ends[i] is where the directory truncated to i subpaths ends in m_path.
+	std::vector<std::size_t> m_ends;
+	std::vector<std::uint64_t> m_hashes;
+};
+
+boost::optional<std::string> normalize_path(const std::string &path, const ProjectRoot &root);
+bool normalize_path(boost::string_view path, const ProjectRoot &root, std::string &normalized_path);
+// root.is_windows() must match Flavor.
+template <typename Flavor>
+bool normalize_path(boost::string_view path, const ProjectRoot &root, std::string &normalized_path);
+
+// Returns path itself when it is canonical, without copying it, and otherwise
+// normalizes it into buffer and returns a view of buffer.
+boost::optional<boost::string_view> normalize_path_view(boost::string_view path, const ProjectRoot &root, std::string &buffer);
+
+// 64-bit FNV-1a of a normalized path, the hash normalized_hash agrees with.
+std::uint64_t normalized_path_hash(boost::string_view normalized_path);
+// normalized_path_hash of what normalize_path would return, computed subpath by subpath
+// without building the normalized path. boost::none if normalize_path would reject path.
+boost::optional<std::uint64_t> normalized_hash(boost::string_view path, const ProjectRoot &root);
+// Whether both paths are valid and normalize to the same path, compared subpath by
+// subpath without building either normalized path.
+bool same_normalized(boost::string_view lhs, boost::string_view rhs, const ProjectRoot &root);
+
+// Allocator aware variants, so that a batch can be normalized into one arena such as
+// a monotonic_buffer_resource and freed with a single release() instead of one free
+// per string. Everything these return is allocated from the given resource.
+boost::container::pmr::vector<boost::container::pmr::string> split_path(boost::string_view path, boost::container::pmr::memory_resource &resource);
+bool normalize(const std::vector<boost::string_view> &subpaths, bool is_windows, boost::container::pmr::string &normalized_path);
+bool normalize_path(boost::string_view path, const ProjectRoot &root, boost::container::pmr::string &normalized_path);
+// Allocates exactly the normalized path from resource. The view stays valid until the
+// resource releases its memory.
+boost::optional<boost::string_view> normalize_path(boost::string_view path, const ProjectRoot &root, boost::container::pmr::memory_resource &resource);
+
+// In-place variants, which write the normalized path over path. A path with a root of
+// its own never grows, except for a bare drive or share such as "C:", so it needs no
+// capacity beyond its size. Other paths need room for the root in front of them.
+std::size_t normalize_path_in_place_capacity(boost::string_view path, const ProjectRoot &root);
+// Returns the normalized size, or boost::none if normalize_path would reject the path
+// or capacity is below normalize_path_in_place_capacity.
+boost::optional<std::size_t> normalize_path_in_place(char *path, std::size_t size, std::size_t capacity, const ProjectRoot &root);
+// Grows path once to normalize_path_in_place_capacity if needed, so reusing the same
+// string for every path makes a loop allocation free. On failure the contents of path
+// are unspecified.
+bool normalize_path_in_place(std::string &path, const ProjectRoot &root);
+
+// A normalized path as derived from its project directory, so that when the project
+// moves it can be rebased onto the new directory with one prefix splice instead of
+// being tokenized, validated and normalized again.
+struct RebasablePath {
+	enum class Anchor : std::uint8_t {
+		// Below the project directory with pop_count of its subpaths removed.
+		project,
+		// Below the drive of the project directory, for Windows paths starting with a separator.
+		drive,
+		// Started with a root or drive of its own, so it does not depend on the project directory.
+		absolute
+	};
+
+	Anchor anchor = Anchor::project;
+	bool is_windows = false;
+	// The drive of a path such as "C:foo", which is only relative to project directories
+	// on that drive. '\0' for every other path.
+	char drive_letter = '\0';
+	// The number of ".." that went up out of the project directory.
+	std::size_t pop_count = 0;
+	// The normalized subpaths below the anchor, separated by '/'. For absolute paths this
+	// is the whole normalized path.
+	std::string tail;
+};
+
+bool normalize_path(boost::string_view path, const ProjectRoot &root, RebasablePath &rebasable_path);
+// Writes what normalize_path would have returned for the original path against root.
+// Fails if root has a different flavor, if the path went up further than root is deep, or
+// if it was relative to a drive root is not on.
+bool rebase_path(const RebasablePath &rebasable_path, const ProjectRoot &root, std::string &normalized_path);
+
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+// A normalized path held in a fixed-capacity buffer, so that it can be built during
+// constant evaluation. Appending past Capacity throws.
+template <std::size_t Capacity>
+class FixedPath {
+public:
+	constexpr FixedPath() : m_data{}, m_size{ 0 } {}
+
+	constexpr std::size_t size() const { return m_size; }
+	constexpr const char *c_str() const { return m_data; }
+	constexpr char operator[](std::size_t index) const { return m_data[index]; }
+	boost::string_view view() const { return boost::string_view{ m_data, m_size }; }
+
+	constexpr void append(boost::string_view data);
+	constexpr void push_back(char c) { append(boost::string_view{ &c, 1 }); }
+	constexpr void resize(std::size_t size);
+	// Position of the last '/', 0 if there is none.
+	constexpr std::size_t last_separator() const;
+
+private:
+	char m_data[Capacity + 1];
+	std::size_t m_size;
+};
+
+// normalize_path against the normalized absolute directory root, written for constant
+// evaluation. Lambdas cannot be constexpr before C++17, so unlike normalize_subpaths it
+// does its own tokenizing.
+template <typename Flavor, std::size_t Capacity>
+constexpr bool normalize_path_constexpr(boost::string_view path, boost::string_view root, FixedPath<Capacity> &normalized_path);
+
+// Normalizes a path literal against a root literal at compile time:
+//   constexpr auto config_path = normalize_path_literal("../etc/app.conf", "/opt/app/bin");
+// A path normalize_path would reject makes the initializer ill-formed, because
+// evaluating it reaches a throw. The flavor follows the root, as for ProjectRoot.
+template <std::size_t PathSize, std::size_t RootSize>
+constexpr FixedPath<PathSize + RootSize> normalize_path_literal(const char (&path)[PathSize], const char (&root)[RootSize]);
+#endif
+
+// Results of normalize_paths in input order. Paths are normalized in chunks, and every
+// chunk writes its results back to back into its own arena, so reusing the object for
+// the next batch keeps all of its buffers.
+class NormalizedPaths {
+public:
+	static const std::size_t chunk_size = 1024;
+
+	std::size_t size() const { return m_entries.size(); }
+	// boost::none for paths normalize_path rejected. Views stay valid until the next batch.
+	boost::optional<boost::string_view> operator[](std::size_t index) const;
+
+private:
+	friend void normalize_paths(const std::vector<boost::string_view> &, const ProjectRoot &, NormalizedPaths &, std::size_t);
+
+	struct Entry {
+		std::size_t offset;
+		std::size_t size;
+		bool is_valid;
+	};
+
+	std::vector<std::string> m_arenas;
+	std::vector<Entry> m_entries;
+};
+
+// Normalizes a batch on thread_count threads, all threads of the machine if 0.
+// Threads claim chunks of paths one at a time, so uneven chunks balance out.
+void normalize_paths(const std::vector<boost::string_view> &paths, const ProjectRoot &root,
+	NormalizedPaths &normalized_paths, std::size_t thread_count = 0);
+
+// Memoizes normalize_path, keyed by ProjectRoot::id and the input path. Entries are
+// spread over independently locked shards, and a full shard evicts with the CLOCK
+// policy, so the cache never holds more than capacity entries, or one if capacity is 0.
+// There are at most capacity shards.
+class NormalizedPathCache {
+public:
+	struct Stats {
+		std::uint64_t hits;
+		std::uint64_t misses;
+		std::uint64_t evictions;
+	};
+
+	explicit NormalizedPathCache(std::size_t capacity, std::size_t shard_count = 16);
+
+	boost::optional<std::string> normalize_path(const std::string &path, const ProjectRoot &root);
+	bool normalize_path(boost::string_view path, const ProjectRoot &root, std::string &normalized_path);
+
+	Stats stats() const;
+	void clear();
+
+private:
+	struct Key {
+		std::uint64_t root_id;
+		std::string path;
+	};
+
+	// Looks entries up without building a Key, so hits do not allocate.
+	struct KeyView {
+		std::uint64_t root_id;
+		boost::string_view path;
+	};
+
+	struct KeyHash {
+		std::size_t operator()(const Key &key) const { return (*this)(KeyView{ key.root_id, key.path }); }
+		std::size_t operator()(const KeyView &key) const;
+	};
+
+	struct KeyEqual {
+		bool operator()(const Key &lhs, const Key &rhs) const { return (*this)(lhs, KeyView{ rhs.root_id, rhs.path }); }
+		bool operator()(const Key &lhs, const KeyView &rhs) const { return lhs.root_id == rhs.root_id && lhs.path == rhs.path; }
+		bool operator()(const KeyView &lhs, const Key &rhs) const { return (*this)(rhs, lhs); }
+	};
+
+	struct Slot {
+		Key key;
+		std::string normalized_path;
+		bool is_valid;
+		bool is_referenced;
+	};
+
+	struct Shard {
+		mutable std::mutex mutex;
+		boost::unordered_map<Key, std::size_t, KeyHash, KeyEqual> index;
+		std::vector<Slot> slots;
+		std::size_t clock_hand = 0;
+		std::uint64_t hits = 0;
+		std::uint64_t misses = 0;
+		std::uint64_t evictions = 0;
+	};
+
+	std::size_t m_shard_capacity;
+	std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+// Resolves paths the way the file system does rather than lexically: a symlink met
+// on the way is replaced by its target before the next subpath, so "link/.." is the
+// parent of what link points to. The project directory is resolved the same way, and
+// subpaths that do not exist are resolved lexically from the last one that does.
+// Paths and link targets are validated as by normalize_path, and root must have the
+// flavor of the host.
+//
+// Every prefix looked up on disk is cached with its lstat and readlink result, spread
+// over independently locked shards, so paths under directories already seen cost no
+// system calls. Entries older than ttl are looked up again when next used, and an
+// expired entry that no longer exists is dropped then. The ttl alone does not bound
+// what is kept, capacity does: a full shard drops its expired entries, then arbitrary
+// ones. prune_expired and invalidate drop entries earlier.
+class PhysicalPathResolver {
+public:
+	struct Stats {
+		std::uint64_t hits;
+		// Lookups that went to the file system, including those of expired entries.
+		std::uint64_t misses;
+		std::uint64_t expirations;
+		// Entries dropped to make room, expired or not.
+		std::uint64_t evictions;
+	};
+
+	// The most symlinks followed for one path, as MAXSYMLINKS on Linux.
+	static const std::size_t max_links = 40;
+	static const std::size_t default_capacity = std::size_t{ 1 } << 20;
+
+	explicit PhysicalPathResolver(std::chrono::steady_clock::duration ttl, std::size_t shard_count = 16,
+		std::size_t capacity = default_capacity);
+
+	boost::optional<std::string> resolve_path(const std::string &path, const ProjectRoot &root);
+	// Fails as normalize_path does, and also for symlink loops.
+	bool resolve_path(boost::string_view path, const ProjectRoot &root, std::string &resolved_path);
+
+	// Drops the cached entries of resolved_path and of everything below it.
+	void invalidate(boost::string_view resolved_path);
+	// Drops every entry older than ttl, and returns how many there were.
+	std::size_t prune_expired();
+
+	Stats stats() const;
+	void clear();
+
+private:
+	template <typename Flavor> friend struct PhysicalOutput;
+
+	enum class EntryKind : std::uint8_t { missing, existing, symlink };
+
+	struct Entry {
+		EntryKind kind;
+		std::string target;
+		std::chrono::steady_clock::time_point expiry;
+	};
+
+	struct PathHash {
+		std::size_t operator()(boost::string_view path) const { return boost::hash_range(path.begin(), path.end()); }
+		std::size_t operator()(const std::string &path) const { return (*this)(boost::string_view{ path }); }
+	};
+
+	struct PathEqual {
+		bool operator()(const std::string &lhs, const std::string &rhs) const { return lhs == rhs; }
+		bool operator()(const std::string &lhs, boost::string_view rhs) const { return boost::string_view{ lhs } == rhs; }
+		bool operator()(boost::string_view lhs, const std::string &rhs) const { return lhs == boost::string_view{ rhs }; }
+	};
+
+	struct Shard {
+		mutable std::mutex mutex;
+		boost::unordered_map<std::string, Entry, PathHash, PathEqual> entries;
+		std::uint64_t hits = 0;
+		std::uint64_t misses = 0;
+		std::uint64_t expirations = 0;
+		std::uint64_t evictions = 0;
+	};
+
+	// Writes the link target for symlinks.
+	EntryKind lookup(boost::string_view path, std::string &target);
+	// Makes room for one more entry in a full shard, whose mutex is held.
+	void evict(Shard &shard, std::chrono::steady_clock::time_point now);
+
+	std::chrono::steady_clock::duration m_ttl;
+	std::size_t m_shard_capacity;
+	std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+// Maps every distinct subpath to a dense 32-bit id, so paths made of common subpaths
+// such as "src" or "include" only store each of them once. Ids are never reused.
+class SubpathInterner {
+public:
+	std::uint32_t intern(boost::string_view subpath);
+	boost::optional<std::uint32_t> find(boost::string_view subpath) const;
+	// Stays valid for the lifetime of the interner.
+	boost::string_view subpath(std::uint32_t id) const;
+	std::size_t size() const;
+
+private:
+	struct SubpathHash {
+		std::size_t operator()(boost::string_view subpath) const { return boost::hash_range(subpath.begin(), subpath.end()); }
+	};
+
+	mutable std::mutex m_mutex;
+	// A deque never moves its strings, so the views in m_ids stay valid as it grows.
+	std::deque<std::string> m_subpaths;
+	boost::unordered_map<boost::string_view, std::uint32_t, SubpathHash> m_ids;
+};
+
+// A normalized path as interned subpath ids, starting with the id of its root, "/" or
+// the drive. Comparing and hashing compact paths only touches integers.
+typedef boost::container::small_vector<std::uint32_t, 8> CompactPath;
+
+struct CompactPathHash {
+	std::size_t operator()(const CompactPath &compact_path) const {
+		return boost::hash_range(compact_path.begin(), compact_path.end());
+	}
+};
+
+bool normalize_path(boost::string_view path, const ProjectRoot &root, SubpathInterner &interner, CompactPath &compact_path);
+std::string expand_path(const CompactPath &compact_path, const SubpathInterner &interner);
+
+// Compact paths as a trie over their subpath ids, for prefix queries. Nodes are stored
+// in depth-first order, so everything under a node is one contiguous run of m_nodes,
+// and the children of every node are one contiguous, id-sorted run of m_child_ids that
+// lookups binary search. Nodes are indexed with 32 bits, so a trie holds at most
+// 2^32 - 1 nodes, one per distinct prefix of its paths plus the root.
+class PathTrie {
+public:
+	PathTrie();
+
+	// The trie is rebuilt from all of its paths, so paths are best inserted in large batches.
+	void insert(const std::vector<CompactPath> &compact_paths);
+
+	std::size_t size() const { return m_size; }
+	bool contains(const CompactPath &compact_path) const;
+	// Calls func on every path that is prefix or lies under it, in id order.
+	template <typename Func>
+	void for_each_under(const CompactPath &prefix, Func func) const;
+	// The number of ids in the longest path of the trie that is a prefix of compact_path.
+	boost::optional<std::size_t> longest_prefix(const CompactPath &compact_path) const;
+
+private:
+	static const std::uint32_t no_node = std::numeric_limits<std::uint32_t>::max();
+
+	struct Node {
+		std::uint32_t id;
+		std::uint32_t parent;
+		std::uint32_t subtree_end;
+		std::uint32_t children_begin;
+		std::uint32_t children_end;
+		bool is_path;
+	};
+
+	std::uint32_t find_child(std::uint32_t node, std::uint32_t id) const;
+	// The node of prefix, or the node of the longest inserted path along it.
+	std::uint32_t find_node(const CompactPath &compact_path, bool longest_path) const;
+
+	std::size_t m_size;
+	std::vector<Node> m_nodes;
+	std::vector<std::uint32_t> m_child_ids;
+	std::vector<std::uint32_t> m_child_nodes;
+};
+
+// Counters of split_path, is_valid_path and the normalize_path overloads taking a
+// ProjectRoot, kept per thread and summed on demand. They are only collected in builds
+// with RESOLVE_PATH_STATS, latencies only with RESOLVE_PATH_STATS_LATENCY as well, and
+// otherwise compiled out, leaving every snapshot zero.
+struct PathStats {
+	enum Operation { split, validate, normalize, operation_count };
+	static const std::size_t latency_buckets = 32;
+
+	struct OperationStats {
+		std::uint64_t calls = 0;
+		std::uint64_t bytes = 0;
+		std::uint64_t subpaths = 0;
+		// Calls rejecting the path, other than for escaping the root.
+		std::uint64_t invalid = 0;
+		// normalize_path calls rejecting the path because a ".." went above its root.
+		std::uint64_t escaped_root = 0;
+		// latency_ns[i] counts calls that took less than 2^i ns, and at least 2^(i-1) ns.
+		std::uint64_t latency_ns[latency_buckets] = {};
+		// The total time of the calls counted in latency_ns.
+		std::uint64_t latency_ns_sum = 0;
+	};
+
+	OperationStats operations[operation_count];
+};
+
+// Includes threads that have exited since the last reset.
+PathStats path_stats_snapshot();
+// Calls racing with a reset on other threads may or may not be counted after it.
+void reset_path_stats();
+// Writes the stats in the Prometheus text format, with the latencies as a histogram of
+// cumulative buckets, their sum and their count.
+void write_path_stats(std::ostream &out, const PathStats &stats);
+
+inline BOOST_CONSTEXPR bool is_separator(char c) {
+	return c == '/' || c == '\\';
+}
+
+inline BOOST_CONSTEXPR bool is_drive_letter(char c) {
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+inline BOOST_CONSTEXPR bool has_windows_drive(boost::string_view first_subpath) {
+	return first_subpath.size() == 2 && is_drive_letter(first_subpath[0]) && first_subpath[1] == ':';
+}
+
+// The flavor functions avoid comparing string_views with ==, which is not constexpr
+// before C++17, so that normalize_path_constexpr below can use them too.
+inline BOOST_CXX14_CONSTEXPR bool PosixFlavor::is_root(boost::string_view first_subpath, bool) {
+	return first_subpath.size() == 1 && first_subpath[0] == '/';
+}
+
+// A share or device root is a single subpath, as the Windows tokenizer hands it on.
+inline BOOST_CXX14_CONSTEXPR bool WindowsFlavor::is_root(boost::string_view first_subpath, bool strict) {
+	if (!strict && PosixFlavor::is_root(first_subpath, strict)) return true;
+
+	const WindowsRoot root = parse_windows_root(first_subpath);
+	return root.size == first_subpath.size() &&
+		(root.kind == WindowsRoot::Kind::drive || root.kind == WindowsRoot::Kind::share);
+}
+
+inline bool is_root(boost::string_view first_subpath, bool is_windows, bool strict) {
+	return is_windows ?
+		WindowsFlavor::is_root(first_subpath, strict) :
+		PosixFlavor::is_root(first_subpath, strict);
+}
+
+// Same check as boost::filesystem::portable_posix_name, without having to copy the
+// subpath into a std::string first.
+inline BOOST_CXX14_CONSTEXPR bool PosixFlavor::is_valid_subpath(boost::string_view subpath) {
+	std::uint8_t flags = 0;
+	for (const char c : subpath) {
+		flags |= SubpathChars::of(c);
+	}
+
+	return (flags & invalid_chars) == 0 && is_valid_name(subpath);
+}
+
+inline BOOST_CXX14_CONSTEXPR bool PosixFlavor::is_valid_name(boost::string_view subpath) {
+	return !subpath.empty();
+}
+
+// Same check as boost::filesystem::windows_name, and no reserved device names.
+inline BOOST_CXX14_CONSTEXPR bool WindowsFlavor::is_valid_subpath(boost::string_view subpath) {
+	std::uint8_t flags = 0;
+	for (const char c : subpath) {
+		flags |= SubpathChars::of(c);
+	}
+
+	return (flags & invalid_chars) == 0 && is_valid_name(subpath);
+}
+
+inline BOOST_CXX14_CONSTEXPR bool WindowsFlavor::is_valid_name(boost::string_view subpath) {
+	// A trailing '.' is only allowed in "." and "..".
+	return !subpath.empty() &&
+		subpath.front() != ' ' &&
+		subpath.back() != ' ' &&
+		(subpath.back() != '.' || subpath.size() == 1 || (subpath.size() == 2 && subpath.front() == '.')) &&
+		!is_reserved_name(subpath);
+}
+
+inline BOOST_CXX14_CONSTEXPR bool WindowsFlavor::is_reserved_name(boost::string_view subpath) {
+	// Only the part before the first '.' counts, and reserved names are 3 or 4 long.
+	std::size_t stem_size = 0;
+	for (; stem_size < subpath.size() && stem_size < 5 && subpath[stem_size] != '.'; ++stem_size);
+	if (stem_size != 3 && stem_size != 4) return false;
+
+	char stem[4] = {};
+	for (std::size_t i = 0; i < stem_size; ++i) {
+		const char c = subpath[i];
+		stem[i] = (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+	}
+
+	const char *const names[] = { "CON", "PRN", "AUX", "NUL", "COM", "LPT" };
+	for (std::size_t i = 0; i < 6; ++i) {
+		if (stem[0] == names[i][0] && stem[1] == names[i][1] && stem[2] == names[i][2]) {
+			// The first four stand alone, COM and LPT take a digit from 1 to 9.
+			return stem_size == 3 ? i < 4 : (i >= 4 && stem[3] >= '1' && stem[3] <= '9');
+		}
+	}
+
+	return false;
+}
+
+inline bool is_valid_subpath(boost::string_view subpath, bool is_windows) {
+	return is_windows ?
+		WindowsFlavor::is_valid_subpath(subpath) :
+		PosixFlavor::is_valid_subpath(subpath);
+}
+
+// The name of a share root starting at offset, up to the next separator.
+inline BOOST_CXX14_CONSTEXPR boost::string_view windows_root_name(boost::string_view path, std::size_t offset) {
+	if (offset >= path.size()) return boost::string_view{};
+
+	std::size_t end = offset;
+	for (; end < path.size() && !is_separator(path[end]); ++end);
+	return path.substr(offset, end - offset);
+}
+
+// "?" and "." stand for the device namespace as a server, but neither is a share.
+inline BOOST_CXX14_CONSTEXPR bool is_valid_windows_root_name(boost::string_view name, bool is_server) {
+	const bool is_device = name.size() == 1 && (name[0] == '?' || name[0] == '.');
+	if (is_device) return is_server;
+
+	const bool is_dot_dot = name.size() == 2 && name[0] == '.' && name[1] == '.';
+	return WindowsFlavor::is_valid_subpath(name) && !is_dot_dot;
+}
+
+// Only a few characters of the path are looked at, and for relative paths only the
+// first two, so it costs next to nothing in front of the tokenizer.
+inline BOOST_CXX14_CONSTEXPR WindowsRoot parse_windows_root(boost::string_view path) {
+	WindowsRoot root{ WindowsRoot::Kind::none, '\0', boost::string_view{}, boost::string_view{}, 0 };
+
+	if (path.size() >= 2 && is_drive_letter(path[0]) && path[1] == ':') {
+		root.kind = path.size() == 2 || is_separator(path[2]) ? WindowsRoot::Kind::drive : WindowsRoot::Kind::drive_relative;
+		root.drive_letter = path[0] >= 'a' ? static_cast<char>(path[0] - 'a' + 'A') : path[0];
+		root.size = 2;
+		return root;
+	}
+	if (path.empty() || !is_separator(path[0])) return root;
+
+	if (path.size() < 3 || !is_separator(path[1]) || is_separator(path[2])) {
+		root.kind = WindowsRoot::Kind::separator;
+		root.size = 1;
+		return root;
+	}
+
+	// Exactly two separators and a name start a share or device. Its names are separated
+	// by exactly one separator, so an empty name is a missing one.
+	root.kind = WindowsRoot::Kind::invalid;
+	const boost::string_view first = windows_root_name(path, 2);
+	std::size_t offset = 2 + first.size();
+	const boost::string_view second = windows_root_name(path, offset + 1);
+	offset += 1 + second.size();
+	root.size = offset < path.size() ? offset : path.size();
+	if (second.empty()) return root;
+
+	const bool is_device = first.size() == 1 && (first[0] == '?' || first[0] == '.');
+	if (is_device && has_windows_drive(second)) {
+		root.kind = WindowsRoot::Kind::drive;
+		root.drive_letter = second[0] >= 'a' ? static_cast<char>(second[0] - 'a' + 'A') : second[0];
+		return root;
+	}
+
+	const bool is_unc = second.size() == 3 &&
+		(second[0] == 'U' || second[0] == 'u') && (second[1] == 'N' || second[1] == 'n') && (second[2] == 'C' || second[2] == 'c');
+	if (is_device && is_unc) {
+		root.server = windows_root_name(path, offset + 1);
+		offset += 1 + root.server.size();
+		root.share = windows_root_name(path, offset + 1);
+		offset += 1 + root.share.size();
+		root.size = offset < path.size() ? offset : path.size();
+	}
+	else {
+		root.server = first;
+		root.share = second;
+	}
+
+	if (is_valid_windows_root_name(root.server, true) && is_valid_windows_root_name(root.share, false)) {
+		root.kind = WindowsRoot::Kind::share;
+	}
+	return root;
+}
+
+inline BOOST_CXX14_CONSTEXPR bool WindowsRoot::is_normalized(boost::string_view path) const {
+	if (kind == Kind::drive) return size == 2 && path[0] == drive_letter;
+
+	return kind == Kind::share &&
+		path[0] == '/' && path[1] == '/' && server.data() == path.data() + 2 &&
+		path[2 + server.size()] == '/' && share.data() == path.data() + 3 + server.size() &&
+		size == 3 + server.size() + share.size();
+}
+
+template <typename Path>
+BOOST_CXX14_CONSTEXPR void WindowsRoot::append_to(Path &path) const {
+	if (kind == Kind::drive || kind == Kind::drive_relative) {
+		path.push_back(drive_letter);
+		path.push_back(':');
+		return;
+	}
+
+	path.push_back('/');
+	path.push_back('/');
+	for (const char c : server) path.push_back(c);
+	path.push_back('/');
+	for (const char c : share) path.push_back(c);
+}
+
+inline BOOST_CXX14_CONSTEXPR bool has_windows_root(boost::string_view path) {
+	const WindowsRoot root = parse_windows_root(path);
+	return root.kind == WindowsRoot::Kind::drive || root.kind == WindowsRoot::Kind::share;
+}
+
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+template <std::size_t Capacity>
+constexpr void FixedPath<Capacity>::append(boost::string_view data) {
+	if (m_size + data.size() > Capacity) throw std::length_error{ "FixedPath capacity exceeded" };
+
+	for (const char c : data) {
+		m_data[m_size++] = c;
+	}
+	m_data[m_size] = '\0';
+}
+
+template <std::size_t Capacity>
+constexpr void FixedPath<Capacity>::resize(std::size_t size) {
+	if (size > Capacity) throw std::length_error{ "FixedPath capacity exceeded" };
+
+	m_size = size;
+	m_data[m_size] = '\0';
+}
+
+template <std::size_t Capacity>
+constexpr std::size_t FixedPath<Capacity>::last_separator() const {
+	std::size_t index = m_size;
+	while (index > 0 && m_data[index - 1] != '/') --index;
+	return index > 0 ? index - 1 : 0;
+}
+
+// Applies one subpath the way normalize_subpaths and NormalizedStringOutput do. A first
+// subpath "/" replaces everything but the root. root_size is the size of the "/", "Z:/"
+// or "//server/share/" that ".." cannot go above.
+template <typename Flavor, std::size_t Capacity>
+constexpr bool apply_subpath(boost::string_view subpath, bool is_first, bool is_root_path,
+	FixedPath<Capacity> &normalized_path, std::size_t &root_size) {
+	if (is_first && PosixFlavor::is_root(subpath, is_root_path)) {
+		if (is_root_path) {
+			if (Flavor::is_windows) return false;
+			normalized_path.resize(0);
+			normalized_path.push_back('/');
+			root_size = 1;
+		}
+		else {
+			normalized_path.resize(root_size);
+		}
+		return true;
+	}
+	if (is_first && is_root_path) return false;
+
+	if (!Flavor::is_valid_subpath(subpath)) return false;
+
+	const bool is_dot = subpath.size() == 1 && subpath[0] == '.';
+	const bool is_dot_dot = subpath.size() == 2 && subpath[0] == '.' && subpath[1] == '.';
+
+	if (is_dot) {
+		return true;
+	}
+	else if (is_dot_dot) {
+		if (normalized_path.size() == root_size) return false;
+		const std::size_t separator = normalized_path.last_separator();
+		normalized_path.resize(separator > root_size ? separator : root_size);
+	}
+	else {
+		if (normalized_path.size() > root_size) normalized_path.push_back('/');
+		normalized_path.append(subpath);
+	}
+
+	return true;
+}
+
+// Tokenizes path the same way as for_each_checked_subpath and applies every subpath.
+// A Windows drive or share replaces the whole path, root included.
+template <typename Flavor, std::size_t Capacity>
+constexpr bool apply_path(boost::string_view path, bool is_root_path,
+	FixedPath<Capacity> &normalized_path, std::size_t &root_size) {
+	const std::size_t path_size = path.size();
+	if (path_size == 0) return false;
+
+	if (!Flavor::is_windows) {
+		for (const char c : path) {
+			if (c == '\\') return false;
+		}
+	}
+
+	std::size_t offset = 0;
+	bool is_first = true;
+	if (Flavor::is_windows) {
+		const WindowsRoot windows_root = parse_windows_root(path);
+		switch (windows_root.kind) {
+		case WindowsRoot::Kind::drive:
+		case WindowsRoot::Kind::share:
+			normalized_path.resize(0);
+			windows_root.append_to(normalized_path);
+			normalized_path.push_back('/');
+			root_size = normalized_path.size();
+			offset = windows_root.size;
+			is_first = false;
+			if (offset < path_size) {
+				const char sep_char = path[offset];
+				for (; offset < path_size && path[offset] == sep_char; ++offset);
+			}
+			break;
+		case WindowsRoot::Kind::drive_relative:
+			if (is_root_path || root_size != 3 || normalized_path[0] != windows_root.drive_letter) return false;
+			offset = windows_root.size;
+			is_first = false;
+			break;
+		case WindowsRoot::Kind::invalid:
+			return false;
+		default:
+			break;
+		}
+	}
+
+	if (is_first) {
+		for (; offset < path_size && is_separator(path[offset]); ++offset);
+		if (offset > 0) {
+			if (!apply_subpath<Flavor>(boost::string_view{ "/", 1 }, is_first, is_root_path, normalized_path, root_size)) return false;
+			is_first = false;
+		}
+	}
+
+	while (offset < path_size) {
+		std::size_t sep = offset;
+		for (; sep < path_size && !is_separator(path[sep]); ++sep);
+
+		const boost::string_view subpath{ path.data() + offset, sep - offset };
+		if (!apply_subpath<Flavor>(subpath, is_first, is_root_path, normalized_path, root_size)) return false;
+		is_first = false;
+		if (sep == path_size) break;
+
+		const char sep_char = path[sep];
+		for (offset = sep; offset < path_size && path[offset] == sep_char; ++offset);
+	}
+
+	return true;
+}
+
+template <typename Flavor, std::size_t Capacity>
+constexpr bool normalize_path_constexpr(boost::string_view path, boost::string_view root, FixedPath<Capacity> &normalized_path) {
+	std::size_t root_size = 0;
+	normalized_path.resize(0);
+
+	return apply_path<Flavor>(root, true, normalized_path, root_size) &&
+		apply_path<Flavor>(path, false, normalized_path, root_size);
+}
+
+template <std::size_t PathSize, std::size_t RootSize>
+constexpr FixedPath<PathSize + RootSize> normalize_path_literal(const char (&path)[PathSize], const char (&root)[RootSize]) {
+	const boost::string_view path_view{ path, PathSize - 1 };
+	const boost::string_view root_view{ root, RootSize - 1 };
+	const bool is_windows = has_windows_root(root_view);
+
+	FixedPath<PathSize + RootSize> normalized_path;
+	const bool is_valid = is_windows ?
+		normalize_path_constexpr<WindowsFlavor>(path_view, root_view, normalized_path) :
+		normalize_path_constexpr<PosixFlavor>(path_view, root_view, normalized_path);
+
+	if (!is_valid) throw std::invalid_argument{ "normalize_path_literal: invalid path or root" };
+	return normalized_path;
+}
+#endif
+
+template <typename Func>
+void PathTrie::for_each_under(const CompactPath &prefix, Func func) const {
+	const std::uint32_t first = find_node(prefix, false);
+	if (first == no_node) return;
+
+	CompactPath compact_path{ prefix };
+	std::vector<std::uint32_t> path_nodes{ first };
+
+	for (std::uint32_t node = first + 1; node <= m_nodes[first].subtree_end; ++node) {
+		if (m_nodes[path_nodes.back()].is_path && path_nodes.back() != 0) func(compact_path);
+		if (node == m_nodes[first].subtree_end) break;
+
+		for (; path_nodes.back() != m_nodes[node].parent; path_nodes.pop_back()) {
+			compact_path.pop_back();
+		}
+		path_nodes.push_back(node);
+		compact_path.push_back(m_nodes[node].id);
+	}
+}
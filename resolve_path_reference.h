@@ -0,0 +1,197 @@
+#pragma once
+
+#include "stdafx.h"
+#include "resolve_path.h"
+
+// Reference tokenizer, kept to check and benchmark split_path against.
+inline std::vector<std::string> split_path_regex(const std::string &path) {
+	const static boost::regex split_reg{ "/+|\\\\+" };
+
+	std::size_t path_size = path.size();
+	std::vector<std::string> split_path;
+
+	std::size_t offset = 0;
+	for (; offset < path_size && (path[offset] == '/' || path[offset] == '\\'); ++offset);
+
+	if (offset > 0) split_path.emplace_back("/");
+
+	std::copy(
+		boost::sregex_token_iterator(path.begin() + offset, path.end(), split_reg, -1),
+		boost::sregex_token_iterator(),
+		std::back_inserter(split_path));
+
+	return split_path;
+}
+
+// boost::filesystem::windows_name, plus the reserved device names it lets through.
+inline bool is_windows_name_reference(const std::string &subpath) {
+	std::string stem = subpath.substr(0, subpath.find('.'));
+	std::transform(stem.begin(), stem.end(), stem.begin(), [](char c) { return (c >= 'a' && c <= 'z') ? char(c - 'a' + 'A') : c; });
+
+	const bool is_reserved = stem == "CON" || stem == "PRN" || stem == "AUX" || stem == "NUL" ||
+		(stem.size() == 4 && (stem.compare(0, 3, "COM") == 0 || stem.compare(0, 3, "LPT") == 0) && stem[3] >= '1' && stem[3] <= '9');
+
+	return boost::filesystem::windows_name(subpath) && !is_reserved;
+}
+
+// A Windows path split with regexes rather than parse_windows_root. root is empty for
+// a relative path, "/" for one starting with a separator, and otherwise the drive or
+// share as normalize_path writes it, "C:" or "//server/share".
+struct WindowsPathReference {
+	std::string root;
+	bool is_drive_relative;
+	std::vector<std::string> subpaths;
+};
+
+inline boost::optional<WindowsPathReference> split_windows_path_reference(const std::string &path) {
+	const static boost::regex drive_reg{ "^([A-Za-z]):" };
+	const static boost::regex device_drive_reg{ "^[/\\\\]{2}[?.][/\\\\]([A-Za-z]):(?=[/\\\\]|$)" };
+	const static boost::regex unc_reg{ "^[/\\\\]{2}[?.][/\\\\]UNC(?=[/\\\\]|$)", boost::regex::icase };
+	const static boost::regex unc_share_reg{ "^[/\\\\]{2}[?.][/\\\\]UNC[/\\\\]([^/\\\\]+)[/\\\\]([^/\\\\]+)(?=[/\\\\]|$)", boost::regex::icase };
+	const static boost::regex share_reg{ "^[/\\\\]{2}([^/\\\\]+)[/\\\\]([^/\\\\]+)(?=[/\\\\]|$)" };
+	const static boost::regex share_start_reg{ "^[/\\\\]{2}[^/\\\\]" };
+
+	const auto upper_drive = [](const std::string &letter) {
+		return std::string(1, static_cast<char>(std::toupper(static_cast<unsigned char>(letter[0])))) + ":";
+	};
+	// "?" and "." are the device namespace, only valid as a server.
+	const auto is_share_name = [](const std::string &name, bool is_server) {
+		if (name == "?" || name == ".") return is_server;
+		return name != ".." && is_windows_name_reference(name);
+	};
+
+	WindowsPathReference split{ std::string{}, false, std::vector<std::string>{} };
+	boost::smatch match;
+	std::string rest;
+
+	if (boost::regex_search(path, match, drive_reg)) {
+		split.root = upper_drive(match[1]);
+		rest = match.suffix();
+		split.is_drive_relative = !rest.empty() && rest[0] != '/' && rest[0] != '\\';
+	}
+	else if (boost::regex_search(path, match, device_drive_reg)) {
+		split.root = upper_drive(match[1]);
+		rest = match.suffix();
+	}
+	else if (boost::regex_search(path, share_start_reg)) {
+		const boost::regex &reg = boost::regex_search(path, unc_reg) ? unc_share_reg : share_reg;
+		if (!boost::regex_search(path, match, reg)) return boost::none;
+		if (!is_share_name(match[1], true) || !is_share_name(match[2], false)) return boost::none;
+		split.root = "//" + match[1].str() + "/" + match[2].str();
+		rest = match.suffix();
+	}
+	else {
+		split.subpaths = split_path(path);
+		if (!split.subpaths.empty() && split.subpaths[0] == "/") {
+			split.root = "/";
+			split.subpaths.erase(split.subpaths.begin());
+		}
+		return split;
+	}
+
+	// A separator run after the root only spans one kind of separator, as everywhere
+	// else, which split_path does for a run after a subpath but not for a leading one.
+	if (split.is_drive_relative) {
+		split.subpaths = split_path(rest);
+	}
+	else {
+		split.subpaths = split_path("." + rest);
+		split.subpaths.erase(split.subpaths.begin());
+	}
+	return split;
+}
+
+// The boost::filesystem based checks is_valid_path and is_normalized_path used before
+// they were instantiated per flavor.
+inline bool is_valid_path_reference(const std::string &path, bool is_windows) {
+	if (is_windows) {
+		const boost::optional<WindowsPathReference> split = split_windows_path_reference(path);
+		if (!split || (split->root.empty() && split->subpaths.empty())) return false;
+
+		return std::all_of(split->subpaths.begin(), split->subpaths.end(),
+			[](const std::string &sub_path) { return is_windows_name_reference(sub_path); });
+	}
+
+	if (path.find("\\") != std::string::npos) return false;
+
+	std::vector<std::string> sub_paths = split_path(path);
+	if (sub_paths.empty()) return false;
+
+	bool has_root = is_root(sub_paths[0], is_windows, false);
+
+	std::size_t offset = (has_root ? 1 : 0);
+	return std::all_of(sub_paths.begin() + offset, sub_paths.end(),
+		[is_windows](const std::string &sub_path) {
+		return (!is_windows && boost::filesystem::portable_posix_name(sub_path)) ||
+			(is_windows && is_windows_name_reference(sub_path));
+	});
+}
+
+inline bool is_normalized_path_reference(const std::string &path, bool is_windows) {
+	if (!is_valid_path_reference(path, is_windows)) return false;
+
+	if (is_windows) {
+		const WindowsPathReference split = *split_windows_path_reference(path);
+		const bool is_normalized_root = split.root.size() > 1 && !split.is_drive_relative && path.compare(0, split.root.size(), split.root) == 0;
+
+		return is_normalized_root && !std::any_of(split.subpaths.begin(), split.subpaths.end(),
+			[](const std::string &subpath) { return subpath == "." || subpath == ".."; });
+	}
+
+	std::vector<std::string> sub_paths = split_path(path);
+
+	if (!is_root(sub_paths[0], is_windows, true)) return false;
+
+	return !std::any_of(sub_paths.begin(), sub_paths.end(),
+		[](const std::string &subpath) { return subpath == "." || subpath == ".."; });
+}
+
+// The split, validate and normalize pipeline normalize_path used before it became a
+// single pass, kept to check the single pass engine against.
+inline boost::optional<std::string> normalize_path_reference(const std::string &path, const std::vector<std::string> &src_prj_dir) {
+	assert(!src_prj_dir.empty());
+	const bool is_windows = has_windows_root(src_prj_dir[0]);
+	assert(is_root(src_prj_dir[0], is_windows, true));
+
+	boost::optional<std::string> ret_opt;
+
+	if (is_windows) {
+		const boost::optional<WindowsPathReference> split = split_windows_path_reference(path);
+		if (!split || !is_valid_path_reference(path, is_windows)) return ret_opt;
+
+		// "/" is on the drive of the project directory, "C:foo" in the project directory
+		// if that is on drive C.
+		const std::string project_root = split_windows_path_reference(src_prj_dir[0])->root;
+		std::vector<std::string> merged_subpaths;
+		if (split->root.empty() || split->is_drive_relative) {
+			if (split->is_drive_relative && split->root != project_root) return ret_opt;
+			merged_subpaths.assign(src_prj_dir.begin(), src_prj_dir.end());
+		}
+		else {
+			merged_subpaths.push_back(split->root == "/" ? src_prj_dir[0] : split->root);
+		}
+		merged_subpaths.insert(merged_subpaths.end(), split->subpaths.begin(), split->subpaths.end());
+		return normalize(merged_subpaths, is_windows);
+	}
+
+	std::vector<std::string> subpaths = split_path(path);
+
+	if (!subpaths.empty()) {
+		if (is_valid_path_reference(path, is_windows)) {
+			const bool has_root = is_root(subpaths[0], is_windows, true);
+
+			if (!has_root) {
+				std::vector<std::string> merged_subpaths;
+				merged_subpaths.reserve(src_prj_dir.size() + subpaths.size());
+				merged_subpaths.insert(merged_subpaths.end(), src_prj_dir.begin(), src_prj_dir.end());
+				merged_subpaths.insert(merged_subpaths.end(), subpaths.begin(), subpaths.end());
+				ret_opt = normalize(merged_subpaths, is_windows);
+			}
+			else {
+				ret_opt = normalize(subpaths, is_windows);
+			}
+		}
+	}
+
+	return ret_opt;
+}
@@ -1,15 +1,46 @@
 #pragma once
 
+#ifdef _WIN32
 #include "targetver.h"
+#include <tchar.h>
+#endif
 
 #include <stdio.h>
-#include <tchar.h>
 #include <assert.h>
 
 #include <string>
 #include <iostream>
+#include <sstream>
 #include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <deque>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/container/pmr/global_resource.hpp>
+#include <boost/container/pmr/string.hpp>
+#include <boost/container/pmr/vector.hpp>
+#include <boost/container/pmr/monotonic_buffer_resource.hpp>
+#include <boost/container/pmr/unsynchronized_pool_resource.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/regex.hpp>
\ No newline at end of file
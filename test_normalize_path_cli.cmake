@@ -0,0 +1,97 @@
+# Runs one case of the normalize_path command line tool and checks its exit code, its
+# output and what it reports on stderr. Run by ctest as
+#   cmake -DNORMALIZE_PATH=<exe> -DSOURCE_DIR=<dir> -DWORK_DIR=<dir> -DCASE=<case> -P test_normalize_path_cli.cmake
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(output_file ${WORK_DIR}/${CASE}.out)
+
+# Runs normalize_path --root /data/sub with ARGS, reading stdin from INPUT if given,
+# and checks that it exits with RESULT and that stderr contains every one of ERRORS.
+# The output is left in output_file.
+function(run_cli)
+	cmake_parse_arguments(CLI "" "INPUT;RESULT" "ARGS;ERRORS" ${ARGN})
+	set(input_args)
+	if(DEFINED CLI_INPUT)
+		set(input_args INPUT_FILE ${CLI_INPUT})
+	endif()
+
+	execute_process(COMMAND ${NORMALIZE_PATH} --root /data/sub ${CLI_ARGS}
+		${input_args} OUTPUT_FILE ${output_file} ERROR_VARIABLE error RESULT_VARIABLE result)
+	if(NOT result EQUAL CLI_RESULT)
+		message(FATAL_ERROR "exited with ${result} instead of ${CLI_RESULT}: ${error}")
+	endif()
+	foreach(expected_error IN LISTS CLI_ERRORS)
+		string(FIND "${error}" "${expected_error}" index)
+		if(index EQUAL -1)
+			message(FATAL_ERROR "stderr does not contain \"${expected_error}\": ${error}")
+		endif()
+	endforeach()
+endfunction()
+
+function(check_output expected)
+	file(READ ${output_file} output)
+	if(NOT output STREQUAL expected)
+		message(FATAL_ERROR "output \"${output}\" instead of \"${expected}\"")
+	endif()
+endfunction()
+
+if(CASE STREQUAL "newline")
+	file(WRITE ${WORK_DIR}/newline.txt "a/b\n../x\n./c/../d\ne")
+	run_cli(INPUT ${WORK_DIR}/newline.txt RESULT 0)
+	check_output("/data/sub/a/b\n/data/x\n/data/sub/d\n/data/sub/e\n")
+
+elseif(CASE STREQUAL "crlf")
+	# Only the CR of a CRLF is dropped, the output is newline separated.
+	file(WRITE ${WORK_DIR}/crlf.txt "a/b\r\n../x\r\nc\r\r\n")
+	run_cli(INPUT ${WORK_DIR}/crlf.txt RESULT 1 ERRORS "line 3: invalid path: c")
+	check_output("/data/sub/a/b\n/data/x\n\n")
+
+elseif(CASE STREQUAL "nul")
+	# The CR of "c\r" is kept, so it is invalid. Without NUL in CMake strings, the output
+	# is compared in hex.
+	run_cli(INPUT ${SOURCE_DIR}/test_normalize_path_cli_nul.txt ARGS -0 RESULT 1
+		ERRORS "line 3: invalid path: \n" "line 4: invalid path: ../../..\n" "line 5: invalid path: c")
+	file(READ ${output_file} output HEX)
+	if(NOT output STREQUAL "2f646174612f7375622f612f62002f646174612f78000000002f646174612f7375622f6400")
+		message(FATAL_ERROR "output ${output} in hex")
+	endif()
+
+elseif(CASE STREQUAL "invalid")
+	file(WRITE ${WORK_DIR}/invalid.txt "a\n../../..\nb\n\n/a/b*\nc\n")
+	run_cli(INPUT ${WORK_DIR}/invalid.txt RESULT 1
+		ERRORS "line 2: invalid path: ../../..\n" "line 4: invalid path: \n" "line 5: invalid path: /a/b*\n")
+	check_output("/data/sub/a\n\n/data/sub/b\n\n\n/data/sub/c\n")
+
+elseif(CASE STREQUAL "files")
+	# Files are read in order, and line numbers carry on across them.
+	file(WRITE ${WORK_DIR}/files_1.txt "a\n../../..\n")
+	file(WRITE ${WORK_DIR}/files_2.txt "")
+	file(WRITE ${WORK_DIR}/files_3.txt "b\nc/../..")
+	file(WRITE ${WORK_DIR}/files_4.txt "*\nd\n")
+	run_cli(ARGS ${WORK_DIR}/files_1.txt ${WORK_DIR}/files_2.txt ${WORK_DIR}/files_3.txt ${WORK_DIR}/files_4.txt RESULT 1
+		ERRORS "line 2: invalid path: ../../..\n" "line 5: invalid path: *\n")
+	check_output("/data/sub/a\n\n/data/sub/b\n/data\n\n/data/sub/d\n")
+
+elseif(CASE STREQUAL "long_record")
+	# A record longer than the 4 MiB chunks, from stdin and from a file.
+	set(long_path "abcdefg/")
+	foreach(i RANGE 1 19)
+		string(APPEND long_path "${long_path}")
+	endforeach()
+	string(APPEND long_path "h")
+	file(WRITE ${WORK_DIR}/long_record.txt "a\n${long_path}\n../b\n")
+
+	run_cli(INPUT ${WORK_DIR}/long_record.txt RESULT 0)
+	check_output("/data/sub/a\n/data/sub/${long_path}\n/data/b\n")
+	run_cli(ARGS ${WORK_DIR}/long_record.txt RESULT 0)
+	check_output("/data/sub/a\n/data/sub/${long_path}\n/data/b\n")
+
+elseif(CASE STREQUAL "write_error")
+	# Writes to /dev/full fail, which has to fail the run rather than lose the output.
+	file(WRITE ${WORK_DIR}/write_error.txt "a\n")
+	set(output_file /dev/full)
+	run_cli(INPUT ${WORK_DIR}/write_error.txt RESULT 2 ERRORS "cannot write stdout")
+
+else()
+	message(FATAL_ERROR "unknown case ${CASE}")
+endif()
@@ -0,0 +1,11 @@
+﻿#include "stdafx.h"
+#include "resolve_path.h"
+
+// Must not compile: ".." above the root makes normalize_path_literal throw during
+// constant evaluation. Built by the normalize_path_literal_invalid test, which expects
+// the build to fail.
+constexpr auto invalid_path = normalize_path_literal("../../..", "/data");
+
+int main() {
+	return static_cast<int>(invalid_path.size());
+}
@@ -0,0 +1,1326 @@
+﻿#include "stdafx.h"
+#include "resolve_path.h"
+#include "resolve_path_reference.h"
+
+#define PRINT_ON 1
+#define PRINT_TEST_ON 0
+
+// While fail_allocation is set, the first allocation made off the main thread throws,
+// and the main thread waits in its allocations for that to happen, so that it cannot
+// take all the work of normalize_paths before the threads it started get to run.
+static std::atomic<bool> fail_allocation{ false };
+static std::atomic<bool> failed_allocation{ false };
+static std::thread::id main_thread_id = std::this_thread::get_id();
+static std::mutex allocation_mutex;
+static std::condition_variable allocation_failed;
+
+void *operator new(std::size_t size) {
+	if (fail_allocation) {
+		if (std::this_thread::get_id() != main_thread_id) {
+			if (!failed_allocation.exchange(true)) {
+				std::lock_guard<std::mutex> lock{ allocation_mutex };
+				allocation_failed.notify_all();
+				throw std::bad_alloc{};
+			}
+		}
+		else {
+			// Before normalize_paths starts its threads there is nothing to wait for.
+			std::unique_lock<std::mutex> lock{ allocation_mutex };
+			allocation_failed.wait_for(lock, std::chrono::milliseconds{ 20 }, []() { return failed_allocation.load(); });
+		}
+	}
+
+	if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+void print_vec(const std::string &ori, std::vector<std::string> &vec) {
+#if PRINT_ON == 1
+	std::cout << ori << " : { ";
+	for (const std::string str : vec) {
+		std::cout << "'" << str << "' ";
+	}
+	std::cout << "}" << std::endl;
+#endif
+}
+
+void test_split_path() {
+#if PRINT_TEST_ON == 1
+	print_vec("", split_path(""));
+	print_vec("/", split_path("/"));
+	print_vec("//", split_path("//"));
+	print_vec("///", split_path("///"));
+
+	print_vec("a", split_path("a"));
+	print_vec("/a", split_path("/a"));
+	print_vec("a/b", split_path("a/b"));
+	print_vec("a/b/c", split_path("a/b/c"));
+	print_vec("/a/b", split_path("/a/b"));
+	print_vec("/a/b/c", split_path("/a/b/c"));
+
+	print_vec(".", split_path("."));
+	print_vec("/.", split_path("/."));
+	print_vec("/./..", split_path("/./.."));
+	print_vec("/./../..", split_path("/./../.."));
+
+	print_vec("a/", split_path("a/"));
+	print_vec("/a/", split_path("/a/"));
+	print_vec("a/b/", split_path("a/b/"));
+	print_vec("a/b/c", split_path("a/b/c/"));
+	print_vec("/a/b/", split_path("/a/b/"));
+	print_vec("/a/b/c", split_path("/a/b/c/"));
+
+	print_vec("./", split_path("./"));
+	print_vec("/./", split_path("/./"));
+	print_vec("/./../", split_path("/./../"));
+	print_vec("/./../../", split_path("/./../../"));
+
+	print_vec("C:", split_path("C:"));
+	print_vec("C:/", split_path("C:/"));
+	print_vec("C:/a", split_path("C:/a"));
+	print_vec("C:/a/b", split_path("C:/a/b"));
+	print_vec("C:/a/b/c", split_path("C:/a/b/c"));
+
+	print_vec("C:/.", split_path("C:/."));
+	print_vec("C:/./..", split_path("C:/./.."));
+	print_vec("C:/./../..", split_path("C:/./../.."));
+
+	print_vec("C:/a/", split_path("C:/a/"));
+	print_vec("C:/a/b/", split_path("C:/a/b/"));
+	print_vec("C:/a/b/c", split_path("C:/a/b/c/"));
+
+	print_vec("C:/./", split_path("C:/./"));
+	print_vec("C:/./../", split_path("C:/./../"));
+	print_vec("C:/./../../", split_path("C:/./../../"));
+
+	print_vec("a//", split_path("a//"));
+	print_vec("//a//", split_path("//a//"));
+	print_vec("a//b//", split_path("a//b//"));
+	print_vec("a//b//c", split_path("a//b//c//"));
+	print_vec("//a//b//", split_path("//a//b//"));
+	print_vec("//a//b//c", split_path("//a/b//c//"));
+
+#endif
+	assert(split_path("") == split_path(""));
+	assert(split_path("/") == split_path("\\"));
+	assert(split_path("a") == split_path("a"));
+	assert(split_path("/a") == split_path("\\a"));
+	assert(split_path("a/b") == split_path("a\\b"));
+	assert(split_path("a/b/c") == split_path("a\\b\\c"));
+	assert(split_path("/a/b") == split_path("\\a\\b"));
+	assert(split_path("/a/b/c") == split_path("\\a\\b\\c"));
+
+	assert(split_path(".") == split_path("."));
+	assert(split_path("/.") == split_path("\\."));
+	assert(split_path("/./..") == split_path("\\.\\.."));
+	assert(split_path("/./../..") == split_path("\\.\\..\\.."));
+
+	assert(split_path("/a//") == split_path("\\a/"));
+	assert(split_path("a/b/") == split_path("a\\b\\"));
+	assert(split_path("a/b/c/") == split_path("a\\b\\c\\"));
+	assert(split_path("/a/b/") == split_path("\\a\\b\\"));
+	assert(split_path("/a/b/c/") == split_path("\\a\\b\\c\\"));
+
+	assert(split_path("./") == split_path(".\\"));
+	assert(split_path("/./") == split_path("\\.\\"));
+	assert(split_path("/./../") == split_path("\\.\\..\\"));
+	assert(split_path("/./../../") == split_path("\\.\\..\\..\\"));
+
+	assert(split_path("a/\\b") == std::vector<std::string>({ "a", "", "b" }));
+	assert(split_path("/\\a\\/") == std::vector<std::string>({ "/", "a", "" }));
+
+	for (const char *path : { "", "/", "\\", "//", "a", "a/", "/a", "a//b", "a/\\b", "a\\/\\b",
+			"a/\\", "\\/a", "/./../", "C:", "C:\\a\\\\b//c", "//a/b//c//", "\\\\a/b\\\\c\\\\" }) {
+		assert(split_path(path) == split_path_regex(path));
+	}
+}
+
+void test_find_separator() {
+	std::vector<const char *(*)(const char *, const char *)> kernels{ find_separator_scalar, find_separator };
+#if SIMD_ON == 1
+	kernels.push_back(find_separator_sse2);
+	if (has_avx2()) kernels.push_back(find_separator_avx2);
+#endif
+
+	std::string path(100, 'a');
+	for (std::size_t size = 0; size <= path.size(); ++size) {
+		for (std::size_t sep = 0; sep <= size; ++sep) {
+			for (char sep_char : { '/', '\\' }) {
+				std::string str = path.substr(0, size);
+				if (sep < size) str[sep] = sep_char;
+				if (sep + 1 < size) str[sep + 1] = sep_char == '/' ? '\\' : '/';
+
+				for (auto kernel : kernels) {
+					assert(kernel(str.data(), str.data() + size) == str.data() + sep);
+				}
+			}
+		}
+	}
+
+	const std::string long_path = std::string(40, 'a') + "/" + std::string(40, 'b') + "\\" + std::string(40, '.') + "//c";
+	assert(split_path(long_path) == split_path_regex(long_path));
+}
+
+void test_split_path_view() {
+	std::vector<boost::string_view> subpaths;
+
+	for (const char *path : { "", "/", "\\", "//", "a", "a/", "/a", "a//b", "a/\\b", "a\\/\\b",
+			"a/\\", "\\/a", "/./../", "C:", "C:\\a\\\\b//c", "//a/b//c//", "\\\\a/b\\\\c\\\\" }) {
+		split_path(path, subpaths);
+		const std::vector<std::string> expected = split_path(std::string{ path });
+		assert(std::equal(subpaths.begin(), subpaths.end(), expected.begin(), expected.end()));
+	}
+}
+
+void test_is_valid_subpath() {
+	for (int c = 0; c < 256; ++c) {
+		for (const std::string &subpath : { std::string(1, char(c)), "a" + std::string(1, char(c)), std::string(1, char(c)) + "a" }) {
+			assert(is_valid_subpath(subpath, false) == boost::filesystem::portable_posix_name(subpath));
+			assert(is_valid_subpath(subpath, true) == is_windows_name_reference(subpath));
+		}
+	}
+
+	for (const char *subpath : { "", ".", "..", "...", "a.", ".a", " a", "a ", "a b", "C:", "con", "CON", "Con.txt",
+			"con.", "cons", "acon", "nul.tar.gz", "PRN", "aux", "COM1", "com9.log", "COM0", "COM10", "LPT5", "lpt", "LPT1x" }) {
+		assert(is_valid_subpath(subpath, false) == boost::filesystem::portable_posix_name(subpath));
+		assert(is_valid_subpath(subpath, true) == is_windows_name_reference(subpath));
+	}
+
+	assert(!is_valid_subpath("con", true));
+	assert(!is_valid_subpath("Com1.txt", true));
+	assert(is_valid_subpath("con", false));
+	assert(is_valid_subpath("console", true));
+}
+
+void test_is_valid_path() {
+	assert(!is_valid_path("", false));
+	assert(!is_valid_path("\\", false));
+	assert(!is_valid_path("C:", false));
+	assert(!is_valid_path("C:/", false));
+	assert(!is_valid_path("C:/a", false));
+
+	assert(is_valid_path("a//b//c//", false));
+	assert(is_valid_path("//a//b//c", false));
+
+	assert(is_valid_path("/", false));
+	assert(is_valid_path("//", false));
+	assert(is_valid_path("///", false));
+	assert(is_valid_path("a", false));
+	assert(is_valid_path("/a", false));
+	assert(is_valid_path("a/b", false));
+	assert(is_valid_path("a/b/c", false));
+	assert(is_valid_path("/a/b", false));
+	assert(is_valid_path("/a/b/c", false));
+
+	assert(is_valid_path(".", false));
+	assert(is_valid_path("/.", false));
+	assert(is_valid_path("/./..", false));
+	assert(is_valid_path("/./../..", false));
+	assert(is_valid_path("a/", false));
+	assert(is_valid_path("/a/", false));
+	assert(is_valid_path("a/b/", false));
+	assert(is_valid_path("a/b/c", false));
+	assert(is_valid_path("/a/b/", false));
+	assert(is_valid_path("/a/b/c", false));
+	assert(is_valid_path("./", false));
+	assert(is_valid_path("/./", false));
+	assert(is_valid_path("/./../", false));
+	assert(is_valid_path("/./../../", false));
+
+	assert(is_valid_path("/", true));
+	assert(is_valid_path("//", true));
+	assert(is_valid_path("///", true));
+	assert(is_valid_path("a", true));
+	assert(is_valid_path("/a", true));
+	assert(is_valid_path("a/b", true));
+	assert(is_valid_path("a/b/c", true));
+	assert(is_valid_path("/a/b", true));
+	assert(is_valid_path("/a/b/c", true));
+
+	assert(is_valid_path(".", true));
+	assert(is_valid_path("/.", true));
+	assert(is_valid_path("/./..", true));
+	assert(is_valid_path("/./../..", true));
+	assert(is_valid_path("a/", true));
+	assert(is_valid_path("/a/", true));
+	assert(is_valid_path("a/b/", true));
+	assert(is_valid_path("a/b/c", true));
+	assert(is_valid_path("/a/b/", true));
+	assert(is_valid_path("/a/b/c", true));
+	assert(is_valid_path("./", true));
+	assert(is_valid_path("/./", true));
+	assert(is_valid_path("/./../", true));
+	assert(is_valid_path("/./../../", true));
+
+	assert(is_valid_path("C:", true));
+	assert(is_valid_path("C:/", true));
+	assert(is_valid_path("C:/a", true));
+	assert(is_valid_path("C:/a/b", true));
+	assert(is_valid_path("C:/a/b/c", true));
+	assert(is_valid_path("C:/.", true));
+	assert(is_valid_path("C:/./..", true));
+	assert(is_valid_path("C:/a/", true));
+	assert(is_valid_path("//a/b//c//", true));
+	assert(is_valid_path("a//b//", true));
+
+	assert(is_valid_path("C:\\", true));
+	assert(is_valid_path("C:\\a", true));
+	assert(is_valid_path("C:\\a\\b", true));
+	assert(is_valid_path("C:\\a\\b\\c", true));
+	assert(is_valid_path("C:\\.", true));
+	assert(is_valid_path("C:\\.\\..", true));
+	assert(is_valid_path("C:\\a\\", true));
+	assert(is_valid_path("\\\\a/b\\\\c\\\\", true));
+	assert(is_valid_path("a\\\\b\\\\", true));
+	assert(is_valid_path("c:\\", true));
+	assert(is_valid_path("C:a", true));
+	assert(is_valid_path("\\\\server\\share", true));
+	assert(is_valid_path("\\\\?\\UNC\\server\\share\\a", true));
+
+	assert(!is_valid_path("C::", true));
+	assert(!is_valid_path("\\\\server", true));
+	assert(!is_valid_path("\\\\server\\\\share", true));
+	assert(!is_valid_path("\\\\server\\..", true));
+	assert(!is_valid_path("\\\\?\\UNC\\server", true));
+
+	assert(!is_valid_path("C:\\a\\con\\b", true));
+	assert(!is_valid_path("aux.h", true));
+	assert(is_valid_path("a/con/b", false));
+
+	// Every char value in and at the edges of the chunks the SIMD kernels of the
+	// validating tokenizer load from a long subpath.
+	for (int c = 0; c < 256; ++c) {
+		for (std::size_t index : { 0, 15, 16, 31, 32, 47 }) {
+			std::string path = "a/" + std::string(48, 'x') + "/b";
+			path[2 + index] = static_cast<char>(c);
+			for (const bool is_windows : { false, true }) {
+				assert(is_valid_path(path, is_windows) == is_valid_path_reference(path, is_windows));
+			}
+		}
+	}
+}
+
+void test_is_normalized_path() {
+	assert(!is_normalized_path("a//b//c//", false));
+	assert(is_normalized_path("//a//b//c", false));
+
+	assert(is_normalized_path("/", false));
+	assert(is_normalized_path("//", false));
+	assert(is_normalized_path("///", false));
+	assert(!is_normalized_path("a", false));
+	assert(is_normalized_path("/a", false));
+	assert(!is_normalized_path("a/b", false));
+	assert(!is_normalized_path("a/b/c", false));
+	assert(is_normalized_path("/a/b", false));
+	assert(is_normalized_path("/a/b/c", false));
+
+	assert(!is_normalized_path(".", false));
+	assert(!is_normalized_path("/.", false));
+	assert(!is_normalized_path("/./..", false));
+	assert(!is_normalized_path("/./../..", false));
+	assert(!is_normalized_path("a/", false));
+	assert(is_normalized_path("/a/", false));
+	assert(!is_normalized_path("a/b/", false));
+	assert(!is_normalized_path("a/b/c", false));
+	assert(is_normalized_path("/a/b/", false));
+	assert(is_normalized_path("/a/b/c", false));
+	assert(!is_normalized_path("./", false));
+	assert(!is_normalized_path("/./", false));
+	assert(!is_normalized_path("/./../", false));
+	assert(!is_normalized_path("/./../../", false));
+
+	assert(!is_normalized_path("/", true));
+	assert(!is_normalized_path("//", true));
+	assert(!is_normalized_path("///", true));
+	assert(!is_normalized_path("a", true));
+	assert(!is_normalized_path("/a", true));
+	assert(!is_normalized_path("a/b", true));
+	assert(!is_normalized_path("a/b/c", true));
+	assert(!is_normalized_path("/a/b", true));
+	assert(!is_normalized_path("/a/b/c", true));
+
+	assert(!is_normalized_path(".", true));
+	assert(!is_normalized_path("/.", true));
+	assert(!is_normalized_path("/./..", true));
+	assert(!is_normalized_path("/./../..", true));
+	assert(!is_normalized_path("a/", true));
+	assert(!is_normalized_path("/a/", true));
+	assert(!is_normalized_path("a/b/", true));
+	assert(!is_normalized_path("a/b/c", true));
+	assert(!is_normalized_path("/a/b/", true));
+	assert(!is_normalized_path("/a/b/c", true));
+	assert(!is_normalized_path("./", true));
+	assert(!is_normalized_path("/./", true));
+	assert(!is_normalized_path("/./../", true));
+	assert(!is_normalized_path("/./../../", true));
+
+	assert(is_normalized_path("C:", true));
+	assert(is_normalized_path("C:/", true));
+	assert(is_normalized_path("C:/a", true));
+	assert(is_normalized_path("C:/a/b", true));
+	assert(is_normalized_path("C:/a/b/c", true));
+	assert(!is_normalized_path("C:/.", true));
+	assert(!is_normalized_path("C:/./..", true));
+	assert(is_normalized_path("C:/a/", true));
+	assert(is_normalized_path("//a/b//c//", true));
+	assert(is_normalized_path("//a/b", true));
+	assert(is_normalized_path("//?/a/", true));
+	assert(!is_normalized_path("c:/a", true));
+	assert(!is_normalized_path("C:a", true));
+	assert(!is_normalized_path("//?/C:/a", true));
+	assert(!is_normalized_path("//?/UNC/a/b", true));
+	assert(!is_normalized_path("a//b//", true));
+
+	assert(is_normalized_path("C:\\", true));
+	assert(is_normalized_path("C:\\a", true));
+	assert(is_normalized_path("C:\\a\\b", true));
+	assert(is_normalized_path("C:\\a\\b\\c", true));
+	assert(!is_normalized_path("C:\\.", true));
+	assert(!is_normalized_path("C:\\.\\..", true));
+	assert(is_normalized_path("C:\\a\\", true));
+	assert(!is_normalized_path("\\\\a/b\\\\c\\\\", true));
+	assert(!is_normalized_path("a\\\\b\\\\", true));
+}
+
+void test_is_canonical_path() {
+	assert(is_canonical_path("/", false));
+	assert(is_canonical_path("/a", false));
+	assert(is_canonical_path("/a/b.c/...", false));
+	assert(!is_canonical_path("", false));
+	assert(!is_canonical_path("a/b", false));
+	assert(!is_canonical_path("//", false));
+	assert(!is_canonical_path("//a", false));
+	assert(!is_canonical_path("/a//b", false));
+	assert(!is_canonical_path("/a/", false));
+	assert(!is_canonical_path("/a/./b", false));
+	assert(!is_canonical_path("/a/..", false));
+	assert(!is_canonical_path("/a\\b", false));
+	assert(!is_canonical_path("/a*b", false));
+
+	assert(is_canonical_path("C:/", true));
+	assert(is_canonical_path("C:/a/b", true));
+	assert(!is_canonical_path("C:", true));
+	assert(!is_canonical_path("/a", true));
+	assert(!is_canonical_path("c:/a", true));
+	assert(!is_canonical_path("C:\\a", true));
+	assert(!is_canonical_path("C:/a\\b", true));
+	assert(!is_canonical_path("C:/a/", true));
+	assert(!is_canonical_path("C://a", true));
+	assert(!is_canonical_path("C:/a./b", true));
+	assert(!is_canonical_path("C:/con", true));
+	assert(!is_canonical_path("C:/a:b", true));
+
+	// Canonical paths are exactly the ones normalize_path returns unchanged.
+	for (const char *src_prj_path : { "/data", "Z:\\data" }) {
+		std::string src_prj_path_copy{ src_prj_path };
+		const bool is_windows = src_prj_path[0] != '/';
+		const std::vector<std::string> src_prj_dir = convert_to_internal_path(src_prj_path_copy, is_windows);
+		const ProjectRoot root{ src_prj_dir };
+		std::string buffer;
+
+		for (const char *path : { "/", "/a", "/a/b", "//a", "/a/", "/a/./b", "C:/", "C:/a", "C:/a/", "C:", "Z:/data", "a", "/a/..", "C:/a/.." }) {
+			const boost::optional<std::string> expected = normalize_path_reference(path, src_prj_dir);
+			assert(is_canonical_path(path, is_windows) == (expected != boost::none && *expected == path));
+
+			const boost::optional<boost::string_view> normalized_view = normalize_path_view(path, root, buffer);
+			assert((normalized_view != boost::none) == (expected != boost::none));
+			assert(expected == boost::none || *expected == *normalized_view);
+			assert(!is_canonical_path(path, is_windows) || normalized_view->data() == path);
+		}
+	}
+}
+
+void test_normalize_path(const std::vector<std::string> &src_prj_dir, const std::string &src_prj_path, const std::string &one_less) {
+	boost::optional<std::string> normalized_path;
+	const bool is_win = has_windows_root(src_prj_dir[0]);
+	std::string drive{ "" };
+	if (is_win) {
+		drive = src_prj_dir[0];
+	}
+
+	auto add_win = [&drive](const char *res) {
+		return drive + res;
+	};
+
+	normalized_path = normalize_path("", src_prj_dir);
+	assert(normalized_path == boost::none);
+
+	normalized_path = normalize_path("/", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/"));
+
+	normalized_path = normalize_path("a//b//c//", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path + "/a/b/c");
+
+	// On Windows two separators and a name start a share, which needs a second name.
+	normalized_path = normalize_path("//a//b//c", src_prj_dir);
+	assert(is_win ? normalized_path == boost::none : normalized_path && *normalized_path == "/a/b/c");
+
+	normalized_path = normalize_path("//", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/"));
+
+	normalized_path = normalize_path("///", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/"));
+
+	normalized_path = normalize_path("a", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path + "/a");
+
+	normalized_path = normalize_path("/a", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/a"));
+
+	normalized_path = normalize_path("a/b", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path+ "/a/b");
+
+	normalized_path = normalize_path("a/b/c", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path + "/a/b/c");
+
+	normalized_path = normalize_path("/a/b", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/a/b"));
+
+	normalized_path = normalize_path(".", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path);
+
+	normalized_path = normalize_path("..", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == one_less);
+
+	normalized_path = normalize_path("/.", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/"));
+
+	normalized_path = normalize_path("/./..", src_prj_dir);
+	assert(normalized_path == boost::none);
+
+	normalized_path = normalize_path("/./..", src_prj_dir);
+	assert(normalized_path == boost::none);
+
+	normalized_path = normalize_path("/./../..", src_prj_dir);
+	assert(normalized_path == boost::none);
+
+	normalized_path = normalize_path("a/", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path + "/a");
+
+	normalized_path = normalize_path("/a/", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/a"));
+
+	normalized_path = normalize_path("a/b/", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path + "/a/b");
+
+	normalized_path = normalize_path("/a/b/", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/a/b"));
+
+	normalized_path = normalize_path("/a/b/c/", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/a/b/c"));
+
+	normalized_path = normalize_path("./", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path);
+
+	normalized_path = normalize_path("/./", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == add_win("/"));
+
+	normalized_path = normalize_path("/./../", src_prj_dir);
+	assert(normalized_path == boost::none);
+
+	normalized_path = normalize_path("/./../../", src_prj_dir);
+	assert(normalized_path == boost::none);
+
+	normalized_path = normalize_path("//a/b//c//", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == (is_win ? "//a/b/c" : "/a/b/c"));
+
+	normalized_path = normalize_path("a//b//", src_prj_dir);
+	assert(normalized_path != boost::none);
+	assert(*normalized_path == src_prj_path + "/a/b");
+
+	if (is_win) {
+		normalized_path = normalize_path("C:", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/");
+
+		normalized_path = normalize_path("C:/", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/");
+
+		normalized_path = normalize_path("C:/a", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a");
+
+		normalized_path = normalize_path("C:/a/b", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a/b");
+
+		normalized_path = normalize_path("C:/a/b/c", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a/b/c");
+
+		normalized_path = normalize_path("C:/.", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/");
+
+		normalized_path = normalize_path("C:/./..", src_prj_dir);
+		assert(normalized_path == boost::none);
+
+		normalized_path = normalize_path("C:/a/", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a");
+
+		normalized_path = normalize_path("C:/a/b/c", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a/b/c");
+		
+		normalized_path = normalize_path("C:\\", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/");
+
+		normalized_path = normalize_path("C:\\a", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a");
+
+		normalized_path = normalize_path("C:\\a\\b", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a/b");
+
+		normalized_path = normalize_path("C:\\a\\b", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a/b");
+
+		normalized_path = normalize_path("C:\\.", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/");
+
+		normalized_path = normalize_path("C:\\.\\..", src_prj_dir);
+		assert(normalized_path == boost::none);
+
+		normalized_path = normalize_path("C:\\a\\", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "C:/a");
+
+		normalized_path = normalize_path("\\\\a/b\\\\c\\\\", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == "//a/b/c");
+
+		normalized_path = normalize_path("a\\\\b\\\\", src_prj_dir);
+		assert(normalized_path != boost::none);
+		assert(*normalized_path == src_prj_path + "/a/b");
+	}
+	else {
+		normalized_path = normalize_path("\\", src_prj_dir);
+		assert(normalized_path == boost::none);
+	}
+
+}
+
+void test_normalize_path_engine(const std::vector<std::string> &src_prj_dir) {
+	const ProjectRoot root{ src_prj_dir };
+	std::string normalized_path;
+
+	for (const char *path : { "", "/", "a//b//c//", "//a//b//c", "a", "/a", ".", "..", "/.", "/./..", "/./../..",
+			"a/", "/a/b/c/", "./", "/./", "/./../", "a/b/../..", "a/b/../../..", "a/./b/../c", "../../..",
+			"\\", "a/\\b", "C:", "C:/a", "C:\\.\\..", "C:\\a\\", "\\\\a/b\\\\c\\\\", "a\\\\b\\\\", "c:\\",
+			"/C:", "a/C:", "C:/a/../..", "a./b", "a /b", "/a/b/c/../../d/./e/..", "..a/b..", "a/*/b",
+			"\\\\?\\C:\\a", "\\\\?\\UNC\\s\\sh\\..", "//s/sh/a/../..", "c:a", "Z:a/..", "Z:..", "\\\\.\\dev\\a" }) {
+		const boost::optional<std::string> expected = normalize_path_reference(path, src_prj_dir);
+		assert(normalize_path(path, src_prj_dir) == expected);
+		assert(normalize_path(path, root) == expected);
+		assert(normalize_path(boost::string_view{ path }, src_prj_dir, normalized_path) == (expected != boost::none));
+		assert(expected == boost::none || *expected == normalized_path);
+	}
+}
+
+void test_path_flavors(const std::vector<std::string> &src_prj_dir) {
+	const ProjectRoot root{ src_prj_dir };
+	std::string normalized_path;
+
+	for (const char *path : { "", "/", "//", "a//b//c//", "//a//b//c", "a", "/a", ".", "..", "/./..", "a/\\b",
+			"\\", "C:", "C:/a", "C:\\.\\..", "c:\\", "/C:", "a/C:", "a./b", "a /b", " a", "a:b", "a|b", "a?b", "a*b" }) {
+		assert(is_valid_path<PosixFlavor>(path) == is_valid_path_reference(path, false));
+		assert(is_valid_path<WindowsFlavor>(path) == is_valid_path_reference(path, true));
+		assert(is_normalized_path<PosixFlavor>(path) == is_normalized_path_reference(path, false));
+		assert(is_normalized_path<WindowsFlavor>(path) == is_normalized_path_reference(path, true));
+
+		const boost::optional<std::string> expected = normalize_path_reference(path, src_prj_dir);
+		const bool is_valid = root.is_windows() ?
+			normalize_path<WindowsFlavor>(path, root, normalized_path) :
+			normalize_path<PosixFlavor>(path, root, normalized_path);
+		assert(is_valid == (expected != boost::none));
+		assert(expected == boost::none || *expected == normalized_path);
+	}
+}
+
+void test_normalize_path_pmr(const std::vector<std::string> &src_prj_dir) {
+	namespace pmr = boost::container::pmr;
+
+	// Everything has to fit in the buffer, since the null upstream throws on any refill.
+	char buffer[16 << 10];
+	pmr::monotonic_buffer_resource arena{ buffer, sizeof(buffer), pmr::null_memory_resource() };
+	const ProjectRoot root{ src_prj_dir };
+	std::vector<boost::string_view> subpaths;
+
+	for (const char *path : { "", "/", "a//b//c//", "a", "/a", ".", "..", "/./..", "a/b/../..", "a/./b/../c",
+			"\\", "a/\\b", "C:", "C:/a", "C:\\.\\..", "c:\\", "a./b", "/a/b/c/../../d/./e/.." }) {
+		const pmr::vector<pmr::string> split = split_path(path, arena);
+		assert(split.get_allocator().resource() == &arena);
+		const std::vector<std::string> expected_split = split_path(path);
+		assert(std::equal(split.begin(), split.end(), expected_split.begin(), expected_split.end(),
+			[](const pmr::string &lhs, const std::string &rhs) { return boost::string_view{ lhs.data(), lhs.size() } == rhs; }));
+
+		const boost::optional<std::string> expected = normalize_path_reference(path, src_prj_dir);
+		pmr::string normalized_path{ &arena };
+		assert(normalize_path(path, root, normalized_path) == (expected != boost::none));
+		assert(expected == boost::none || *expected == boost::string_view(normalized_path.data(), normalized_path.size()));
+
+		const boost::optional<boost::string_view> normalized_view = normalize_path(path, root, arena);
+		assert((normalized_view != boost::none) == (expected != boost::none));
+		assert(expected == boost::none || *expected == *normalized_view);
+
+		split_path(path, subpaths);
+		if (!subpaths.empty() && is_root(subpaths[0], root.is_windows(), true)) {
+			pmr::string normalized{ &arena };
+			std::string expected_normalized;
+			assert(normalize(subpaths, root.is_windows(), normalized) == normalize(subpaths, root.is_windows(), expected_normalized));
+			assert(boost::string_view(normalized.data(), normalized.size()) == boost::string_view(expected_normalized));
+		}
+	}
+
+	// After a release the same buffer serves the next batch.
+	arena.release();
+	assert(normalize_path("a/b", root, arena) != boost::none);
+}
+
+void test_normalize_path_in_place(const std::vector<std::string> &src_prj_dir) {
+	const ProjectRoot root{ src_prj_dir };
+	std::string buffer;
+
+	for (const char *path : { "", "/", "a//b//c//", "//a//b//c", "a", "/a", ".", "..", "/./..", "a/b/../..", "a/./b/../c",
+			"\\", "a/\\b", "C:", "C:/a", "C:\\.\\..", "C:\\a\\", "\\\\a/b\\\\c\\\\", "c:\\", "/C:",
+			"a./b", "/a/b/c/../../d/./e/..", "../a/../..", "x/../../y", "\\\\s\\sh", "//s/sh",
+			"\\\\?\\C:\\a", "\\\\?\\UNC\\s\\sh\\..", "//s/sh/a/../..", "c:a", "Z:a/..", "Z:..", "\\\\.\\dev\\a" }) {
+		const boost::optional<std::string> expected = normalize_path_reference(path, src_prj_dir);
+
+		buffer = path;
+		assert(normalize_path_in_place(buffer, root) == (expected != boost::none));
+		assert(expected == boost::none || *expected == buffer);
+
+		// Exactly the capacity the path asks for, and one byte less.
+		const std::size_t size = std::strlen(path);
+		const std::size_t capacity = normalize_path_in_place_capacity(path, root);
+		std::vector<char> exact(path, path + size);
+		exact.resize(capacity);
+		const boost::optional<std::size_t> normalized_size = normalize_path_in_place(exact.data(), size, capacity, root);
+		assert((normalized_size != boost::none) == (expected != boost::none));
+		assert(expected == boost::none || *expected == boost::string_view(exact.data(), *normalized_size));
+		std::copy(path, path + size, exact.begin());
+		assert(normalize_path_in_place(exact.data(), size, capacity - 1, root) == boost::none);
+	}
+
+	// Paths with a root of their own fit in their own size.
+	const char *const absolute_path = root.is_windows() ? "C:\\a\\..\\b" : "/a/../b";
+	assert(normalize_path_in_place_capacity(absolute_path, root) == std::strlen(absolute_path));
+}
+
+void test_normalized_hash(const std::vector<std::string> &src_prj_dir) {
+	const ProjectRoot root{ src_prj_dir };
+	const char *const paths[] = { "", "/", "a//b//c//", "/a/b/c", "a", "/a", ".", "..", "/./..", "a/b/../..", "a/./b/../c",
+		"../data/a/c", "\\", "a/\\b", "C:", "C:/", "C:/a", "C:\\a\\", "Z:/data", "Z:/data/a/c", "/data/a/c", "x/../../y", "../../..",
+		"c:/a", "\\\\?\\C:\\a", "Z:a/c", "//s/sh", "\\\\s\\sh\\", "\\\\?\\UNC\\s\\sh" };
+
+	for (const char *path : paths) {
+		const boost::optional<std::string> expected = normalize_path_reference(path, src_prj_dir);
+		const boost::optional<std::uint64_t> hash = normalized_hash(path, root);
+		assert((hash != boost::none) == (expected != boost::none));
+		assert(expected == boost::none || *hash == normalized_path_hash(*expected));
+
+		for (const char *other_path : paths) {
+			const boost::optional<std::string> other_expected = normalize_path_reference(other_path, src_prj_dir);
+			assert(same_normalized(path, other_path, root) == (expected != boost::none && expected == other_expected));
+		}
+	}
+
+	// The 64-bit FNV-1a test vectors.
+	assert(normalized_path_hash("") == 0xcbf29ce484222325ull);
+	assert(normalized_path_hash("a") == 0xaf63dc4c8601ec8cull);
+}
+
+void test_rebase_path(const std::vector<std::string> &src_prj_dir) {
+	const ProjectRoot root{ src_prj_dir };
+	const bool is_windows = root.is_windows();
+
+	// The project moved deeper, to the root and to another flavor.
+	std::string moved_path = is_windows ? "Y:\\mnt\\ws\\data" : "/mnt/ws/data";
+	const ProjectRoot moved_root{ convert_to_internal_path(moved_path, is_windows) };
+	std::string top_path = is_windows ? "Y:\\" : "/";
+	const ProjectRoot top_root{ convert_to_internal_path(top_path, is_windows) };
+	std::string other_path = is_windows ? "/data" : "Z:\\data";
+	const ProjectRoot other_root{ convert_to_internal_path(other_path, !is_windows) };
+
+	RebasablePath rebasable_path;
+	std::string normalized_path;
+	std::string rebased_path;
+
+	for (const char *path : { "/", "a//b//c//", "a", "/a", ".", "..", "/./..", "a/b/../..", "a/./b/../c", "../../a",
+			"../x/../y", "C:", "C:/a", "C:\\a\\..", "\\a\\b", "a./b", "/a/b/c/../../d/./e/..", "../a/../..", "Z:a", "Z:..\\b", "z:." }) {
+		const bool is_valid = normalize_path(path, root, rebasable_path);
+		assert(is_valid == (normalize_path_reference(path, src_prj_dir) != boost::none));
+		if (!is_valid) continue;
+
+		for (const ProjectRoot *target : { &root, &moved_root, &top_root }) {
+			const bool is_rebased = rebase_path(rebasable_path, *target, rebased_path);
+			assert(is_rebased == normalize_path(path, *target, normalized_path));
+			assert(!is_rebased || rebased_path == normalized_path);
+		}
+		assert(!rebase_path(rebasable_path, other_root, rebased_path));
+	}
+
+	assert(normalize_path("../../a/./b", moved_root, rebasable_path));
+	assert(rebasable_path.anchor == RebasablePath::Anchor::project);
+	assert(rebasable_path.pop_count == 2);
+	assert(rebasable_path.tail == "a/b");
+	assert(!rebase_path(rebasable_path, root, rebased_path));
+
+	assert(normalize_path("/x/y/..", root, rebasable_path));
+	assert(rebasable_path.anchor == (is_windows ? RebasablePath::Anchor::drive : RebasablePath::Anchor::absolute));
+	assert(rebasable_path.tail == (is_windows ? "x" : "/x"));
+
+	// "Z:a" is only relative to project directories on drive Z.
+	if (is_windows && root.drive() == "Z:") {
+		assert(normalize_path("z:..\\b", root, rebasable_path));
+		assert(rebasable_path.anchor == RebasablePath::Anchor::project);
+		assert(rebasable_path.drive_letter == 'Z');
+		assert(!rebase_path(rebasable_path, moved_root, rebased_path));
+		assert(rebase_path(rebasable_path, root, rebased_path));
+		assert(rebased_path == "Z:/b");
+	}
+}
+
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+template <std::size_t Capacity>
+constexpr bool operator==(const FixedPath<Capacity> &fixed_path, const char *expected) {
+	std::size_t index = 0;
+	for (; index < fixed_path.size() && expected[index] == fixed_path[index]; ++index);
+	return index == fixed_path.size() && expected[index] == '\0';
+}
+
+void test_normalize_path_constexpr(const std::vector<std::string> &src_prj_dir) {
+	static_assert(normalize_path_literal("a/./b/../c", "/data/sub") == "/data/sub/a/c", "");
+	static_assert(normalize_path_literal("../../x", "/data/sub") == "/x", "");
+	static_assert(normalize_path_literal("..", "/data") == "/", "");
+	static_assert(normalize_path_literal("//a//b//c//", "/data") == "/a/b/c", "");
+	static_assert(normalize_path_literal("a\\b", "Z:\\data") == "Z:/data/a/b", "");
+	static_assert(normalize_path_literal("\\a\\..\\b", "Z:/data") == "Z:/b", "");
+	static_assert(normalize_path_literal("C:/a/..", "Z:/data") == "C:/", "");
+
+	const ProjectRoot root{ src_prj_dir };
+	const std::string root_path{ root.path().data(), root.path().size() };
+
+	for (const char *path : { "", "/", "a//b//c//", "//a//b//c", "a", "/a", ".", "..", "/.", "/./..", "/./../..",
+			"a/", "/a/b/c/", "./", "/./", "/./../", "a/b/../..", "a/b/../../..", "a/./b/../c", "../../..",
+			"\\", "a/\\b", "C:", "C:/a", "C:\\.\\..", "C:\\a\\", "\\\\a/b\\\\c\\\\", "a\\\\b\\\\", "c:\\",
+			"/C:", "a/C:", "C:/a/../..", "a./b", "a /b", "/a/b/c/../../d/./e/..", "..a/b..", "a/*/b",
+			"\\\\?\\C:\\a", "\\\\?\\UNC\\s\\sh\\..", "//s/sh/a/../..", "c:a", "Z:a/..", "Z:..", "\\\\.\\dev\\a" }) {
+		const boost::optional<std::string> expected = normalize_path(path, root);
+
+		FixedPath<256> normalized_path;
+		const bool is_valid = root.is_windows() ?
+			normalize_path_constexpr<WindowsFlavor>(path, root_path, normalized_path) :
+			normalize_path_constexpr<PosixFlavor>(path, root_path, normalized_path);
+		assert(is_valid == (expected != boost::none));
+		assert(expected == boost::none || normalized_path.view() == *expected);
+	}
+}
+#endif
+
+void test_project_root() {
+	std::string src_prj_path{ "/data/sub" };
+	const ProjectRoot posix_root{ convert_to_internal_path(src_prj_path, false) };
+	assert(!posix_root.is_windows());
+	assert(posix_root.drive() == "");
+	assert(posix_root.depth() == 2);
+	assert(posix_root.path() == "/data/sub");
+	assert(posix_root.path(1) == "/data");
+	assert(posix_root.path(0) == "/");
+
+	src_prj_path = "Z:\\data\\sub";
+	const ProjectRoot windows_root{ convert_to_internal_path(src_prj_path, true) };
+	assert(windows_root.is_windows());
+	assert(windows_root.drive() == "Z:");
+	assert(windows_root.depth() == 2);
+	assert(windows_root.path() == "Z:/data/sub");
+	assert(windows_root.path(1) == "Z:/data");
+	assert(windows_root.path(0) == "Z:/");
+
+	src_prj_path = "/";
+	const ProjectRoot top_root{ convert_to_internal_path(src_prj_path, false) };
+	assert(top_root.depth() == 0);
+	assert(top_root.path() == "/");
+
+	assert(*normalize_path("../../x", posix_root) == "/x");
+	assert(*normalize_path("../../x/..", windows_root) == "Z:/");
+	assert(*normalize_path("..", posix_root) == "/data");
+	assert(*normalize_path(".././y/../../", windows_root) == "Z:/");
+	assert(normalize_path("../../..", posix_root) == boost::none);
+	assert(normalize_path("C:/..", windows_root) == boost::none);
+	assert(*normalize_path("C:/a/..", windows_root) == "C:/");
+	assert(*normalize_path("C:/a", windows_root) == "C:/a");
+	assert(*normalize_path("/a/../b", windows_root) == "Z:/b");
+
+	// The overloads taking src_prj_dir reuse the root of the last one, until it changes.
+	std::string data_path{ "/data" };
+	const std::vector<std::string> data_dir = convert_to_internal_path(data_path, false);
+	std::vector<std::string> sub_dir = data_dir;
+	sub_dir.push_back("sub");
+	assert(*normalize_path("a", data_dir) == "/data/a");
+	assert(*normalize_path("a", sub_dir) == "/data/sub/a");
+	sub_dir.back() = "other";
+	assert(*normalize_path("a", sub_dir) == "/data/other/a");
+	assert(*normalize_path("a", data_dir) == "/data/a");
+}
+
+void test_windows_roots() {
+	std::string src_prj_path{ "Z:\\data\\sub" };
+	const ProjectRoot root{ convert_to_internal_path(src_prj_path, true) };
+
+	assert(*normalize_path("c:\\a", root) == "C:/a");
+	assert(*normalize_path("c:", root) == "C:/");
+	assert(*normalize_path("z:" + std::string(40, 'a') + "\\b", root) == "Z:/data/sub/" + std::string(40, 'a') + "/b");
+	assert(*normalize_path("\\\\server\\share", root) == "//server/share/");
+	assert(*normalize_path("\\\\server\\share\\a\\..\\b", root) == "//server/share/b");
+	assert(*normalize_path("//server/share/", root) == "//server/share/");
+	assert(*normalize_path("\\\\?\\C:\\a", root) == "C:/a");
+	assert(*normalize_path("\\\\.\\c:", root) == "C:/");
+	assert(*normalize_path("\\\\?\\UNC\\server\\share\\a", root) == "//server/share/a");
+	assert(*normalize_path("\\\\?\\unc\\server\\share", root) == "//server/share/");
+	assert(*normalize_path("\\\\?\\Volume{1}\\a", root) == "//?/Volume{1}/a");
+	assert(*normalize_path("\\\\.\\pipe\\a", root) == "//./pipe/a");
+
+	// ".." does not go above the share, and the share is not a subpath.
+	assert(normalize_path("\\\\server\\share\\..", root) == boost::none);
+	assert(normalize_path("\\\\server\\..\\a", root) == boost::none);
+	assert(normalize_path("\\\\server", root) == boost::none);
+	assert(normalize_path("\\\\server\\\\share", root) == boost::none);
+	assert(normalize_path("\\\\?\\UNC\\server", root) == boost::none);
+	assert(normalize_path("\\\\?\\.", root) == boost::none);
+	assert(normalize_path("\\\\server\\sh:re", root) == boost::none);
+
+	// A drive without a separator is relative to the project directory on that drive.
+	assert(*normalize_path("Z:a\\b", root) == "Z:/data/sub/a/b");
+	assert(*normalize_path("z:..\\a", root) == "Z:/data/a");
+	assert(*normalize_path("Z:.", root) == "Z:/data/sub");
+	assert(normalize_path("C:a", root) == boost::none);
+	assert(normalize_path("Z:../../..", root) == boost::none);
+
+	assert(*normalized_hash("\\\\?\\UNC\\server\\share\\a", root) == normalized_path_hash("//server/share/a"));
+	assert(same_normalized("c:\\a", "\\\\?\\C:\\a", root));
+	assert(same_normalized("Z:a", "a", root));
+	assert(!same_normalized("\\\\server\\share", "\\\\server\\other", root));
+
+	std::string in_place_path{ "\\\\?\\UNC\\server\\share\\a\\.\\b" };
+	assert(normalize_path_in_place(in_place_path, root));
+	assert(in_place_path == "//server/share/a/b");
+
+	// A project directory on a share resolves separators and ".." against the share.
+	src_prj_path = "//server/share/data";
+	const ProjectRoot share_root{ convert_to_internal_path(src_prj_path, true) };
+	assert(share_root.is_windows());
+	assert(share_root.drive() == "//server/share");
+	assert(share_root.path(0) == "//server/share/");
+	assert(*normalize_path("..", share_root) == "//server/share/");
+	assert(*normalize_path("\\a", share_root) == "//server/share/a");
+	assert(normalize_path("../..", share_root) == boost::none);
+	assert(normalize_path("Z:a", share_root) == boost::none);
+
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+	static_assert(normalize_path_literal("\\\\?\\UNC\\s\\sh\\a", "Z:/data") == "//s/sh/a", "");
+	static_assert(normalize_path_literal("z:a", "Z:/data") == "Z:/data/a", "");
+	static_assert(normalize_path_literal("..", "//s/sh/data") == "//s/sh/", "");
+#endif
+}
+
+void test_normalize_paths() {
+	std::string src_prj_path{ "Z:\\data\\sub" };
+	const ProjectRoot root{ convert_to_internal_path(src_prj_path, true) };
+
+	std::vector<std::string> storage;
+	for (std::size_t i = 0; i < 3 * NormalizedPaths::chunk_size + 7; ++i) {
+		const char *inputs[] = { "a/b", "../../..", "..\\x", "C:/y/./z", "", "/q/../r", "a/\\b" };
+		storage.push_back(inputs[i % 7] + std::string(i % 3, 'c'));
+	}
+	const std::vector<boost::string_view> paths(storage.begin(), storage.end());
+
+	NormalizedPaths normalized_paths;
+	for (std::size_t thread_count : { 1, 4, 0 }) {
+		normalize_paths(paths, root, normalized_paths, thread_count);
+		assert(normalized_paths.size() == paths.size());
+
+		for (std::size_t i = 0; i < paths.size(); ++i) {
+			const boost::optional<std::string> expected = normalize_path(storage[i], root);
+			assert(normalized_paths[i] == boost::none ? expected == boost::none : *normalized_paths[i] == *expected);
+		}
+	}
+
+	normalize_paths({}, root, normalized_paths);
+	assert(normalized_paths.size() == 0);
+
+	// An exception on a thread normalize_paths started reaches the caller.
+	fail_allocation = true;
+	bool is_thrown = false;
+	try {
+		normalize_paths(paths, root, normalized_paths, 4);
+	}
+	catch (const std::bad_alloc &) {
+		is_thrown = true;
+	}
+	fail_allocation = false;
+	assert(is_thrown && failed_allocation);
+}
+
+void test_normalized_path_cache() {
+	std::string src_prj_path{ "/data" };
+	const ProjectRoot data_root{ convert_to_internal_path(src_prj_path, false) };
+	src_prj_path = "/data/sub";
+	const ProjectRoot sub_root{ convert_to_internal_path(src_prj_path, false) };
+	assert(data_root.id() != sub_root.id());
+	assert(ProjectRoot{ data_root }.id() == data_root.id());
+
+	NormalizedPathCache cache{ 4, 1 };
+	assert(*cache.normalize_path("../x", sub_root) == "/data/x");
+	assert(*cache.normalize_path("../x", data_root) == "/x");
+	assert(*cache.normalize_path("../x", sub_root) == "/data/x");
+	assert(cache.normalize_path("../..", data_root) == boost::none);
+	assert(cache.normalize_path("../..", data_root) == boost::none);
+
+	NormalizedPathCache::Stats stats = cache.stats();
+	assert(stats.hits == 2 && stats.misses == 3 && stats.evictions == 0);
+
+	// "../x" against sub_root was referenced, so the unreferenced entries go first.
+	for (const char *path : { "a", "b", "c" }) {
+		assert(*cache.normalize_path(path, data_root) == std::string{ "/data/" } + path);
+	}
+	stats = cache.stats();
+	assert(stats.misses == 6 && stats.evictions == 2);
+
+	cache.clear();
+	assert(*cache.normalize_path("a", data_root) == "/data/a");
+	assert(cache.stats().misses == 7);
+
+	// Fewer entries than shards.
+	NormalizedPathCache small_cache{ 3, 16 };
+	for (std::size_t i = 0; i < 20; ++i) {
+		assert(*small_cache.normalize_path(std::to_string(i), data_root) == "/data/" + std::to_string(i));
+	}
+	stats = small_cache.stats();
+	assert(stats.misses == 20 && stats.misses - stats.evictions <= 3);
+
+	NormalizedPathCache shared_cache{ 64 };
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < 4; ++t) {
+		threads.emplace_back([&shared_cache, &sub_root, t]() {
+			std::string normalized_path;
+			for (std::size_t i = 0; i < 2000; ++i) {
+				const std::string path = "../" + std::to_string((i * (t + 1)) % 100);
+				assert(shared_cache.normalize_path(path, sub_root, normalized_path));
+				assert(normalized_path == "/data/" + std::to_string((i * (t + 1)) % 100));
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	stats = shared_cache.stats();
+	assert(stats.hits + stats.misses == 8000);
+}
+
+#ifndef _WIN32
+// Creating symlinks on Windows needs a privilege test machines may not have.
+void test_physical_path_resolver() {
+	namespace fs = boost::filesystem;
+
+	// The temporary directory may be below a symlink itself, as /tmp is on macOS.
+	const fs::path dir = fs::canonical(fs::temp_directory_path()) / fs::unique_path("resolve_path_%%%%%%%%");
+	fs::create_directories(dir / "a" / "b");
+	fs::create_symlink("a/b", dir / "link");
+	fs::create_symlink(dir / "a", dir / "abs");
+	fs::create_symlink("loop", dir / "loop");
+	fs::create_symlink("../../..", dir / "a" / "up");
+
+	std::string src_prj_path = dir.string();
+	const ProjectRoot root{ convert_to_internal_path(src_prj_path, false) };
+	src_prj_path = (dir / "link").string();
+	const ProjectRoot link_root{ convert_to_internal_path(src_prj_path, false) };
+	const std::string a = (dir / "a").string();
+	const std::string b = (dir / "a" / "b").string();
+
+	PhysicalPathResolver resolver{ std::chrono::hours{ 1 }, 4 };
+	assert(*resolver.resolve_path("link/..", root) == a);
+	assert(*normalize_path("link/..", root) == dir.string());
+	assert(*resolver.resolve_path("link/./c/../../b", root) == b);
+	assert(*resolver.resolve_path("abs/b", root) == b);
+	assert(*resolver.resolve_path("..", link_root) == a);
+	assert(*resolver.resolve_path(b, link_root) == b);
+	// Subpaths that do not exist resolve lexically.
+	assert(*resolver.resolve_path("link/x/y/../z", root) == b + "/x/z");
+	assert(*resolver.resolve_path("x/../link", root) == b);
+	assert(resolver.resolve_path("loop", root) == boost::none);
+	assert(resolver.resolve_path("a/b/../up/../../../../..", root) == boost::none);
+	assert(resolver.resolve_path("a\\b", root) == boost::none);
+
+	// Everything is cached now, so resolving again costs no lookups.
+	const PhysicalPathResolver::Stats stats = resolver.stats();
+	assert(stats.misses > 0 && stats.expirations == 0);
+	assert(*resolver.resolve_path("link/..", root) == a);
+	assert(*resolver.resolve_path("..", link_root) == a);
+	assert(resolver.stats().misses == stats.misses);
+	assert(resolver.stats().hits > stats.hits);
+
+	// A changed link is only seen once its entry is invalidated or expired.
+	fs::remove(dir / "link");
+	fs::create_symlink("a", dir / "link");
+	assert(*resolver.resolve_path("link/..", root) == a);
+	resolver.invalidate((dir / "link").string());
+	assert(*resolver.resolve_path("link/..", root) == dir.string());
+
+	PhysicalPathResolver uncached_resolver{ std::chrono::steady_clock::duration::zero() };
+	assert(*uncached_resolver.resolve_path("link/b", root) == b);
+	fs::remove(dir / "link");
+	assert(*uncached_resolver.resolve_path("link/b", root) == dir.string() + "/link/b");
+	assert(uncached_resolver.stats().expirations > 0);
+
+	// The expired entry of link is dropped now that it is missing, while a path first
+	// seen missing is kept like any other.
+	PhysicalPathResolver fresh_resolver{ std::chrono::steady_clock::duration::zero() };
+	assert(*fresh_resolver.resolve_path("a/b", root) == b);
+	assert(*fresh_resolver.resolve_path("link/b", root) == dir.string() + "/link/b");
+	assert(uncached_resolver.prune_expired() + 1 == fresh_resolver.prune_expired());
+	assert(uncached_resolver.prune_expired() == 0);
+
+	// A full shard makes room, and what was dropped is looked up again.
+	PhysicalPathResolver small_resolver{ std::chrono::hours{ 1 }, 4, 1 };
+	assert(*small_resolver.resolve_path("a/b", root) == b);
+	assert(small_resolver.stats().evictions > 0);
+	assert(small_resolver.prune_expired() == 0);
+	const std::uint64_t small_misses = small_resolver.stats().misses;
+	assert(*small_resolver.resolve_path("a/b", root) == b);
+	assert(small_resolver.stats().misses > small_misses);
+
+	resolver.invalidate("/");
+	const std::uint64_t misses = resolver.stats().misses;
+	assert(*resolver.resolve_path("abs", root) == a);
+	assert(resolver.stats().misses > misses);
+
+	fs::remove_all(dir);
+}
+#endif
+
+void test_compact_path() {
+	SubpathInterner interner;
+	assert(interner.intern("src") == interner.intern(std::string{ "src" }));
+	assert(interner.intern("include") != interner.intern("src"));
+	assert(interner.subpath(interner.intern("include")) == "include");
+	assert(*interner.find("src") == interner.intern("src"));
+	assert(interner.find("missing") == boost::none);
+	assert(interner.size() == 2);
+
+	for (const char *src_prj_path_str : { "/data/src", "Z:\\data\\src" }) {
+		std::string src_prj_path{ src_prj_path_str };
+		const bool is_windows = has_windows_drive(src_prj_path.substr(0, 2));
+		const ProjectRoot root{ convert_to_internal_path(src_prj_path, is_windows) };
+		CompactPath compact_path;
+
+		for (const char *path : { "", "/", "a//b//c//", "//a//b//c", "a", ".", "..", "../..", "../../..",
+				"/./..", "a/./b/../c", "../src/include", "C:/a/../b", "C:/..", "a/\\b" }) {
+			const boost::optional<std::string> expected = normalize_path(path, root);
+			assert(normalize_path(path, root, interner, compact_path) == (expected != boost::none));
+			assert(expected == boost::none || expand_path(compact_path, interner) == *expected);
+		}
+
+		CompactPath other_path;
+		assert(normalize_path("../src/include/./x", root, interner, compact_path));
+		assert(normalize_path("include/y/../x", root, interner, other_path));
+		assert(compact_path == other_path);
+		assert(CompactPathHash{}(compact_path) == CompactPathHash{}(other_path));
+		assert(compact_path[compact_path.size() - 2] == *interner.find("include"));
+	}
+}
+
+void test_path_trie() {
+	std::string src_prj_path{ "Z:\\data" };
+	const ProjectRoot root{ convert_to_internal_path(src_prj_path, true) };
+	SubpathInterner interner;
+
+	auto compact = [&root, &interner](const char *path) {
+		CompactPath compact_path;
+		const bool is_valid = normalize_path(path, root, interner, compact_path);
+		assert(is_valid);
+		return compact_path;
+	};
+
+	PathTrie trie;
+	assert(trie.size() == 0);
+	assert(!trie.contains(compact("a")));
+	assert(trie.longest_prefix(compact("a")) == boost::none);
+
+	trie.insert({ compact("sub/x"), compact("sub/y/z"), compact("other"), compact("sub"), compact("C:/sub/x") });
+	trie.insert({ compact("sub/y"), compact("./sub/x") });
+	assert(trie.size() == 6);
+
+	assert(trie.contains(compact("sub")));
+	assert(trie.contains(compact("sub/y/z")));
+	assert(trie.contains(compact("C:/sub/x")));
+	assert(!trie.contains(compact("/")));
+	assert(!trie.contains(compact("C:/sub")));
+	assert(!trie.contains(compact("sub/y/z/w")));
+	assert(!trie.contains(CompactPath{}));
+
+	std::vector<std::string> under;
+	trie.for_each_under(compact("sub"), [&under, &interner](const CompactPath &compact_path) {
+		under.push_back(expand_path(compact_path, interner));
+	});
+	assert(under.size() == 4);
+	assert(std::is_permutation(under.begin(), under.end(),
+		std::vector<std::string>({ "Z:/data/sub", "Z:/data/sub/x", "Z:/data/sub/y", "Z:/data/sub/y/z" }).begin()));
+
+	std::size_t count = 0;
+	trie.for_each_under(CompactPath{}, [&count](const CompactPath &) { ++count; });
+	assert(count == trie.size());
+	trie.for_each_under(compact("missing"), [&count](const CompactPath &) { ++count; });
+	assert(count == trie.size());
+
+	const CompactPath deep = compact("sub/y/z/w/v");
+	assert(*trie.longest_prefix(deep) == deep.size() - 2);
+	assert(*trie.longest_prefix(compact("sub/q")) == compact("sub").size());
+	assert(trie.longest_prefix(compact("C:/sub")) == boost::none);
+	assert(trie.longest_prefix(compact("/")) == boost::none);
+}
+
+void test_path_stats() {
+	std::string src_prj_path{ "/data" };
+	const ProjectRoot root{ convert_to_internal_path(src_prj_path, false) };
+	std::string normalized_path;
+
+	reset_path_stats();
+	split_path(std::string{ "/a/b" });
+	is_valid_path("a/*", false);
+	normalize_path("a/./b", root, normalized_path);
+	normalize_path("../../a", root, normalized_path);
+	normalize_path("a/b\\c", root, normalized_path);
+
+	// Threads that have exited still count.
+	std::thread{ [&root]() { std::string normalized_path; normalize_path("x/..", root, normalized_path); } }.join();
+
+	const PathStats stats = path_stats_snapshot();
+	const PathStats::OperationStats &split = stats.operations[PathStats::split];
+	const PathStats::OperationStats &validate = stats.operations[PathStats::validate];
+	const PathStats::OperationStats &normalize = stats.operations[PathStats::normalize];
+
+#ifdef RESOLVE_PATH_STATS
+	assert(split.calls == 1 && split.bytes == 4 && split.subpaths == 3);
+	assert(validate.calls == 1 && validate.invalid == 1 && validate.subpaths == 2);
+	assert(normalize.calls == 4 && normalize.bytes == 21);
+	assert(normalize.invalid == 1 && normalize.escaped_root == 1);
+#else
+	assert(split.calls == 0 && validate.calls == 0 && normalize.calls == 0);
+#endif
+
+	// Every call took at least as long as the lower bound of its bucket.
+	std::uint64_t latency_count = 0;
+	std::uint64_t latency_ns_min = 0;
+	for (std::size_t bucket = 0; bucket < PathStats::latency_buckets; ++bucket) {
+		latency_count += normalize.latency_ns[bucket];
+		if (bucket > 0) latency_ns_min += normalize.latency_ns[bucket] << (bucket - 1);
+	}
+	assert(normalize.latency_ns_sum >= latency_ns_min);
+#ifdef RESOLVE_PATH_STATS_LATENCY
+	assert(latency_count == 4);
+#else
+	assert(latency_count == 0 && normalize.latency_ns_sum == 0);
+#endif
+
+	std::ostringstream out;
+	write_path_stats(out, stats);
+	assert(out.str().find("resolve_path_calls_total{operation=\"normalize\"} " + std::to_string(normalize.calls) + "\n") != std::string::npos);
+	assert(out.str().find("resolve_path_latency_ns_bucket{operation=\"split\",le=\"+Inf\"}") != std::string::npos);
+	assert(out.str().find("resolve_path_latency_ns_sum{operation=\"normalize\"} " + std::to_string(normalize.latency_ns_sum) + "\n") != std::string::npos);
+
+	reset_path_stats();
+	assert(path_stats_snapshot().operations[PathStats::normalize].calls == 0);
+}
+
+int main() {
+	test_split_path();
+	test_split_path_view();
+	test_find_separator();
+	test_is_valid_subpath();
+	test_is_valid_path();
+	test_is_normalized_path();
+	test_is_canonical_path();
+	test_project_root();
+	test_windows_roots();
+	test_normalize_paths();
+	test_normalized_path_cache();
+#ifndef _WIN32
+	test_physical_path_resolver();
+#endif
+	test_compact_path();
+	test_path_trie();
+	test_path_stats();
+
+	std::string src_prj_path{ "/data" };
+	std::vector<std::string> src_prj_dir = convert_to_internal_path(src_prj_path, false);
+	test_normalize_path(src_prj_dir, "/data", "/");
+	test_normalize_path_engine(src_prj_dir);
+	test_path_flavors(src_prj_dir);
+	test_normalize_path_pmr(src_prj_dir);
+	test_normalize_path_in_place(src_prj_dir);
+	test_normalized_hash(src_prj_dir);
+	test_rebase_path(src_prj_dir);
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+	test_normalize_path_constexpr(src_prj_dir);
+#endif
+	
+	src_prj_path = "Z:\\data";
+	src_prj_dir = convert_to_internal_path(src_prj_path, true);
+	test_normalize_path(src_prj_dir, "Z:/data", "Z:/");
+	test_normalize_path_engine(src_prj_dir);
+	test_path_flavors(src_prj_dir);
+	test_normalize_path_pmr(src_prj_dir);
+	test_normalize_path_in_place(src_prj_dir);
+	test_normalized_hash(src_prj_dir);
+	test_rebase_path(src_prj_dir);
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+	test_normalize_path_constexpr(src_prj_dir);
+#endif
+
+	src_prj_path = "//server/share/data";
+	src_prj_dir = convert_to_internal_path(src_prj_path, true);
+	test_normalize_path(src_prj_dir, "//server/share/data", "//server/share/");
+	test_normalize_path_engine(src_prj_dir);
+	test_path_flavors(src_prj_dir);
+	test_normalize_path_pmr(src_prj_dir);
+	test_normalize_path_in_place(src_prj_dir);
+	test_normalized_hash(src_prj_dir);
+	test_rebase_path(src_prj_dir);
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+	test_normalize_path_constexpr(src_prj_dir);
+#endif
+
+	return 0;
+}